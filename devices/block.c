@@ -3,7 +3,10 @@
 #include <string.h>
 #include <stdio.h>
 #include "devices/ide.h"
+#include "devices/timer.h"
+#include "threads/interrupt.h"
 #include "threads/malloc.h"
+#include "threads/synch.h"
 
 /* A block device. */
 struct block
@@ -17,10 +20,48 @@ struct block
   const struct block_operations *ops; /* Driver operations. */
   void *aux;                          /* Extra data owned by driver. */
 
+  /* Requests not yet taken by the driver, in the order chosen by
+     the I/O scheduler.  Only used with interrupts off. */
+  const struct block_scheduler *sched; /* Orders QUEUE. */
+  struct list queue;                   /* Queued requests. */
+  size_t queue_len;                    /* Number of requests in QUEUE. */
+  block_sector_t next_sector;          /* Just past the last request
+                                          taken by the driver. */
+
+  /* Adjacent requests merged into one for the driver. */
+  struct block_request merged;         /* The merged request. */
+  void *merged_buffers[BLOCK_VEC_MAX]; /* Buffers for MERGED. */
+  struct list merged_list;             /* Requests that make it up. */
+  bool merged_busy;                    /* Is MERGED in use? */
+
   unsigned long long read_cnt;  /* Number of sectors read. */
   unsigned long long write_cnt; /* Number of sectors written. */
+
+  unsigned long long request_cnt; /* Number of requests queued. */
+  unsigned long long merge_cnt;   /* Requests merged into others. */
+  unsigned long long depth_sum;   /* Sum of queue lengths seen by each
+                                     request as it was queued. */
 };
 
+/* An I/O scheduler, which decides the order in which queued
+   requests reach a device's driver. */
+struct block_scheduler
+{
+  const char *name;
+
+  /* Adds a request to the device's queue. */
+  void (*add) (struct block *, struct block_request *);
+
+  /* Returns the request in the nonempty queue that the driver
+     should get next, without removing it. */
+  struct block_request *(*choose) (struct block *);
+};
+
+/* How long a read or a write may wait in a queue before the I/O
+   scheduler takes it regardless of where it lies on disk. */
+#define READ_DEADLINE (TIMER_FREQ / 2)
+#define WRITE_DEADLINE (TIMER_FREQ * 5)
+
 /* List of all block devices. */
 static struct list all_blocks = LIST_INITIALIZER (all_blocks);
 
@@ -29,6 +70,88 @@ static struct block *block_by_role[BLOCK_ROLE_CNT];
 
 static struct block *list_elem_to_block (struct list_elem *);
 
+/* First-in, first-out: requests reach the driver in the order
+   they were submitted. */
+static void fifo_add (struct block *block, struct block_request *r)
+{
+  list_push_back (&block->queue, &r->elem);
+}
+
+static struct block_request *fifo_choose (struct block *block)
+{
+  return list_entry (list_front (&block->queue), struct block_request,
+                     elem);
+}
+
+/* Returns true if request A starts before request B. */
+static bool sector_less (const struct list_elem *a_,
+                         const struct list_elem *b_, void *aux UNUSED)
+{
+  const struct block_request *a = list_entry (a_, struct block_request, elem);
+  const struct block_request *b = list_entry (b_, struct block_request, elem);
+
+  return a->sector < b->sector;
+}
+
+/* C-LOOK: the queue is kept sorted by sector, and the driver gets
+   the first request at or past the end of the one before it,
+   wrapping around to the lowest sector at the end of each sweep.
+   A request past its deadline goes first, so that a stream of
+   requests near the head cannot starve one far away. */
+static void clook_add (struct block *block, struct block_request *r)
+{
+  list_insert_ordered (&block->queue, &r->elem, sector_less, NULL);
+}
+
+static struct block_request *clook_choose (struct block *block)
+{
+  struct block_request *next = NULL;
+  struct block_request *oldest = NULL;
+  struct list_elem *e;
+
+  for (e = list_begin (&block->queue); e != list_end (&block->queue);
+       e = list_next (e))
+    {
+      struct block_request *r = list_entry (e, struct block_request, elem);
+
+      if (oldest == NULL || r->deadline < oldest->deadline)
+        oldest = r;
+      if (next == NULL && r->sector >= block->next_sector)
+        next = r;
+    }
+
+  if (oldest->deadline <= timer_ticks ())
+    return oldest;
+  if (next == NULL)
+    next = list_entry (list_front (&block->queue), struct block_request,
+                       elem);
+  return next;
+}
+
+/* Available I/O schedulers.  The first is the default. */
+static const struct block_scheduler schedulers[] = {
+    {"clook", clook_add, clook_choose},
+    {"fifo", fifo_add, fifo_choose},
+};
+
+/* I/O scheduler for devices registered from now on. */
+static const struct block_scheduler *default_scheduler = &schedulers[0];
+
+/* Makes block devices registered from now on use the I/O
+   scheduler with the given NAME.  Panics if there is none. */
+void block_configure_scheduler (const char *name)
+{
+  size_t i;
+
+  for (i = 0; i < sizeof schedulers / sizeof *schedulers; i++)
+    if (name != NULL && !strcmp (name, schedulers[i].name))
+      {
+        default_scheduler = &schedulers[i];
+        return;
+      }
+  PANIC ("unknown I/O scheduler `%s'", name != NULL ? name : "");
+}
+
 /* Returns a human-readable name for the given block device
    TYPE. */
 const char *block_type_name (enum block_type type)
@@ -101,15 +224,243 @@ static void check_sector (struct block *block, block_sector_t sector)
     }
 }
 
+/* Verifies that the CNT sectors starting at SECTOR lie within
+   BLOCK.  Panics if not. */
+static void check_sectors (struct block *block, block_sector_t sector,
+                           size_t cnt)
+{
+  check_sector (block, sector);
+  if (cnt > block->size - sector)
+    PANIC ("Access past end of device %s (sector=%" PRDSNu ", count=%zu, "
+           "size=%" PRDSNu ")\n",
+           block_name (block), sector, cnt, block->size);
+}
+
+/* Initializes R as a request to transfer the CNT consecutive
+   sectors starting at SECTOR, each to or from its buffer in
+   BUFFERS, writing them if WRITE is true and reading them
+   otherwise.  DONE will be called with R, whose AUX member is set
+   to AUX, when the transfer is complete. */
+void block_request_init (struct block_request *r, block_sector_t sector,
+                         size_t cnt, bool write, void *const buffers[],
+                         block_done_func *done, void *aux)
+{
+  ASSERT (cnt > 0 && cnt <= BLOCK_VEC_MAX);
+  ASSERT (done != NULL);
+
+  r->sector = sector;
+  r->cnt = cnt;
+  r->write = write;
+  r->buffers = buffers;
+  r->done = done;
+  r->aux = aux;
+}
+
+/* Carries out R on BLOCK through its driver's synchronous
+   operations. */
+static void transfer (struct block *block, struct block_request *r)
+{
+  const struct block_operations *ops = block->ops;
+  size_t i;
+
+  if (!r->write && ops->readv != NULL)
+    ops->readv (block->aux, r->sector, r->cnt, r->buffers);
+  else if (r->write && ops->writev != NULL)
+    ops->writev (block->aux, r->sector, r->cnt,
+                 (const void *const *) r->buffers);
+  else
+    for (i = 0; i < r->cnt; i++)
+      if (r->write)
+        ops->write (block->aux, r->sector + i, r->buffers[i]);
+      else
+        ops->read (block->aux, r->sector + i, r->buffers[i]);
+}
+
+/* Submits request R to BLOCK and returns, usually before the
+   transfer is complete.  R's DONE function is called once it is,
+   possibly from an interrupt handler.  Drivers without a START
+   operation carry out R before this function returns.  Requests
+   to one device may complete in any order. */
+void block_submit (struct block *block, struct block_request *r)
+{
+  check_sectors (block, r->sector, r->cnt);
+  ASSERT (!r->write || block->type != BLOCK_FOREIGN);
+
+  if (r->write)
+    block->write_cnt += r->cnt;
+  else
+    block->read_cnt += r->cnt;
+
+  if (block->ops->start != NULL)
+    {
+      enum intr_level old_level = intr_disable ();
+      r->deadline =
+          timer_ticks () + (r->write ? WRITE_DEADLINE : READ_DEADLINE);
+      block->sched->add (block, r);
+      block->queue_len++;
+      block->request_cnt++;
+      block->depth_sum += block->queue_len;
+      block->ops->start (block->aux);
+      intr_set_level (old_level);
+    }
+  else
+    {
+      transfer (block, r);
+      block_complete (r);
+    }
+}
+
+/* Returns a request in BLOCK's queue for sectors in the same
+   direction as WRITE that ends at START or begins at END and has
+   at most ROOM sectors, or a null pointer if there is none. */
+static struct block_request *find_adjacent (struct block *block,
+                                            block_sector_t start,
+                                            block_sector_t end, bool write,
+                                            size_t room)
+{
+  struct list_elem *e;
+
+  for (e = list_begin (&block->queue); e != list_end (&block->queue);
+       e = list_next (e))
+    {
+      struct block_request *r = list_entry (e, struct block_request, elem);
+
+      if (r->write == write && r->cnt <= room &&
+          (r->sector + r->cnt == start || r->sector == end))
+        return r;
+    }
+  return NULL;
+}
+
+/* Completes each of the requests that make up BLOCK's merged
+   request M. */
+static void merged_done (struct block_request *m)
+{
+  struct block *block = m->aux;
+  struct list done;
+
+  /* Free MERGED first, since completing a request may submit
+     another. */
+  list_init (&done);
+  while (!list_empty (&block->merged_list))
+    list_push_back (&done, list_pop_front (&block->merged_list));
+  block->merged_busy = false;
+
+  while (!list_empty (&done))
+    block_complete (
+        list_entry (list_pop_front (&done), struct block_request, elem));
+}
+
+/* Merges the requests in BLOCK's queue that continue R on disk in
+   either direction into one request of at most BLOCK_VEC_MAX
+   sectors.  Returns the merged request, or R if there was nothing
+   to merge or BLOCK's merged request is still in use. */
+static struct block_request *merge (struct block *block,
+                                    struct block_request *r)
+{
+  struct block_request *m = &block->merged;
+  struct block_request *q;
+
+  if (block->merged_busy)
+    return r;
+  q = find_adjacent (block, r->sector, r->sector + r->cnt, r->write,
+                     BLOCK_VEC_MAX - r->cnt);
+  if (q == NULL)
+    return r;
+
+  block->merged_busy = true;
+  list_init (&block->merged_list);
+  list_push_back (&block->merged_list, &r->elem);
+  memcpy (block->merged_buffers, r->buffers, r->cnt * sizeof *r->buffers);
+  block_request_init (m, r->sector, r->cnt, r->write, block->merged_buffers,
+                      merged_done, block);
+  do
+    {
+      list_remove (&q->elem);
+      block->queue_len--;
+      block->merge_cnt++;
+      if (q->sector == m->sector + m->cnt)
+        {
+          memcpy (block->merged_buffers + m->cnt, q->buffers,
+                  q->cnt * sizeof *q->buffers);
+          list_push_back (&block->merged_list, &q->elem);
+        }
+      else
+        {
+          memmove (block->merged_buffers + q->cnt, block->merged_buffers,
+                   m->cnt * sizeof *block->merged_buffers);
+          memcpy (block->merged_buffers, q->buffers,
+                  q->cnt * sizeof *q->buffers);
+          list_push_front (&block->merged_list, &q->elem);
+          m->sector = q->sector;
+        }
+      m->cnt += q->cnt;
+    }
+  while ((q = find_adjacent (block, m->sector, m->sector + m->cnt, m->write,
+                             BLOCK_VEC_MAX - m->cnt)) != NULL);
+  return m;
+}
+
+/* Removes and returns the request in BLOCK's queue that its I/O
+   scheduler picks, merged with any requests adjacent to it on
+   disk, or returns a null pointer if the queue is empty.  For use
+   by drivers with a START operation, which must complete the
+   returned request as usual.  Interrupts must be off. */
+struct block_request *block_dequeue (struct block *block)
+{
+  struct block_request *r;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (list_empty (&block->queue))
+    return NULL;
+  r = block->sched->choose (block);
+  list_remove (&r->elem);
+  block->queue_len--;
+  r = merge (block, r);
+  block->next_sector = r->sector + r->cnt;
+  return r;
+}
+
+/* Reports that the transfer requested by R is complete.  For use
+   by drivers. */
+void block_complete (struct block_request *r) { r->done (r); }
+
+/* Wakes up the thread waiting for R in submit_and_wait(). */
+static void wake_up (struct block_request *r) { sema_up (r->aux); }
+
+/* Transfers the CNT consecutive sectors starting at SECTOR between
+   BLOCK and BUFFERS, writing if WRITE is true and reading
+   otherwise, and waits until the transfer is complete. */
+static void submit_and_wait (struct block *block, block_sector_t sector,
+                             size_t cnt, void *const buffers[], bool write)
+{
+  check_sectors (block, sector, cnt);
+  while (cnt > 0)
+    {
+      size_t n = cnt < BLOCK_VEC_MAX ? cnt : BLOCK_VEC_MAX;
+      struct block_request r;
+      struct semaphore done;
+
+      sema_init (&done, 0);
+      block_request_init (&r, sector, n, write, buffers, wake_up, &done);
+      block_submit (block, &r);
+      sema_down (&done);
+
+      sector += n;
+      buffers += n;
+      cnt -= n;
+    }
+}
+
 /* Reads sector SECTOR from BLOCK into BUFFER, which must
    have room for BLOCK_SECTOR_SIZE bytes.
    Internally synchronizes accesses to block devices, so external
    per-block device locking is unneeded. */
 void block_read (struct block *block, block_sector_t sector, void *buffer)
 {
-  check_sector (block, sector);
-  block->ops->read (block->aux, sector, buffer);
-  block->read_cnt++;
+  void *const buffers[1] = {buffer};
+  submit_and_wait (block, sector, 1, buffers, false);
 }
 
 /* Write sector SECTOR to BLOCK from BUFFER, which must contain
@@ -120,10 +471,77 @@ void block_read (struct block *block, block_sector_t sector, void *buffer)
 void block_write (struct block *block, block_sector_t sector,
                   const void *buffer)
 {
-  check_sector (block, sector);
-  ASSERT (block->type != BLOCK_FOREIGN);
-  block->ops->write (block->aux, sector, buffer);
-  block->write_cnt++;
+  void *const buffers[1] = {(void *) buffer};
+  submit_and_wait (block, sector, 1, buffers, true);
+}
+
+/* Reads the CNT consecutive sectors starting at SECTOR from BLOCK,
+   each into the buffer for it in BUFFERS, which must have room for
+   BLOCK_SECTOR_SIZE bytes.  Drivers that support it transfer the
+   whole run with as few commands as they can.
+   Internally synchronizes accesses to block devices, so external
+   per-block device locking is unneeded. */
+void block_readv (struct block *block, block_sector_t sector, size_t cnt,
+                  void *const buffers[])
+{
+  submit_and_wait (block, sector, cnt, buffers, false);
+}
+
+/* Writes the CNT consecutive sectors starting at SECTOR to BLOCK,
+   each from the buffer for it in BUFFERS, which must contain
+   BLOCK_SECTOR_SIZE bytes.  Returns after the block device has
+   acknowledged receiving the data.  Drivers that support it
+   transfer the whole run with as few commands as they can.
+   Internally synchronizes accesses to block devices, so external
+   per-block device locking is unneeded. */
+void block_writev (struct block *block, block_sector_t sector, size_t cnt,
+                   const void *const buffers[])
+{
+  submit_and_wait (block, sector, cnt, (void *const *) buffers, true);
+}
+
+/* Reads the CNT consecutive sectors starting at SECTOR from BLOCK
+   into BUFFER, which must have room for CNT * BLOCK_SECTOR_SIZE
+   bytes.  See block_readv(). */
+void block_read_multiple (struct block *block, block_sector_t sector,
+                          size_t cnt, void *buffer)
+{
+  void *buffers[BLOCK_VEC_MAX];
+
+  while (cnt > 0)
+    {
+      size_t n = cnt < BLOCK_VEC_MAX ? cnt : BLOCK_VEC_MAX;
+      size_t i;
+
+      for (i = 0; i < n; i++)
+        buffers[i] = (uint8_t *) buffer + i * BLOCK_SECTOR_SIZE;
+      block_readv (block, sector, n, buffers);
+      sector += n;
+      buffer = (uint8_t *) buffer + n * BLOCK_SECTOR_SIZE;
+      cnt -= n;
+    }
+}
+
+/* Writes the CNT consecutive sectors starting at SECTOR to BLOCK
+   from BUFFER, which must contain CNT * BLOCK_SECTOR_SIZE bytes.
+   See block_writev(). */
+void block_write_multiple (struct block *block, block_sector_t sector,
+                           size_t cnt, const void *buffer)
+{
+  const void *buffers[BLOCK_VEC_MAX];
+
+  while (cnt > 0)
+    {
+      size_t n = cnt < BLOCK_VEC_MAX ? cnt : BLOCK_VEC_MAX;
+      size_t i;
+
+      for (i = 0; i < n; i++)
+        buffers[i] = (const uint8_t *) buffer + i * BLOCK_SECTOR_SIZE;
+      block_writev (block, sector, n, buffers);
+      sector += n;
+      buffer = (const uint8_t *) buffer + n * BLOCK_SECTOR_SIZE;
+      cnt -= n;
+    }
 }
 
 /* Returns the number of sectors in BLOCK. */
@@ -135,9 +553,12 @@ const char *block_name (struct block *block) { return block->name; }
 /* Returns BLOCK's type. */
 enum block_type block_type (struct block *block) { return block->type; }
 
-/* Prints statistics for each block device used for a Pintos role. */
+/* Prints statistics for each block device used for a Pintos role,
+   and I/O scheduler statistics for each block device that has had
+   requests queued. */
 void block_print_stats (void)
 {
+  struct list_elem *e;
   int i;
 
   for (i = 0; i < BLOCK_ROLE_CNT; i++)
@@ -150,6 +571,21 @@ void block_print_stats (void)
                   block->write_cnt);
         }
     }
+
+  for (e = list_begin (&all_blocks); e != list_end (&all_blocks);
+       e = list_next (e))
+    {
+      struct block *block = list_entry (e, struct block, list_elem);
+      unsigned long long depth;
+
+      if (block->request_cnt == 0)
+        continue;
+      depth = block->depth_sum * 100 / block->request_cnt;
+      printf ("%s (%s): %llu requests, %llu merged, "
+              "average queue depth %llu.%02llu\n",
+              block->name, block->sched->name, block->request_cnt,
+              block->merge_cnt, depth / 100, depth % 100);
+    }
 }
 
 /* Registers a new block device with the given NAME.  If
@@ -171,8 +607,14 @@ struct block *block_register (const char *name, enum block_type type,
   block->size = size;
   block->ops = ops;
   block->aux = aux;
+  block->sched = default_scheduler;
+  list_init (&block->queue);
+  block->queue_len = 0;
+  block->next_sector = 0;
+  block->merged_busy = false;
   block->read_cnt = 0;
   block->write_cnt = 0;
+  block->request_cnt = block->merge_cnt = block->depth_sum = 0;
 
   printf ("%s: %'" PRDSNu " sectors (", block->name, block->size);
   print_human_readable_size ((uint64_t) block->size * BLOCK_SECTOR_SIZE);
@@ -1,8 +1,10 @@
 #ifndef DEVICES_BLOCK_H
 #define DEVICES_BLOCK_H
 
+#include <stdbool.h>
 #include <stddef.h>
 #include <inttypes.h>
+#include <list.h>
 
 /* Size of a block device sector in bytes.
    All IDE disks use this sector size, as do most USB and SCSI
@@ -53,20 +55,84 @@ struct block *block_next (struct block *);
 block_sector_t block_size (struct block *);
 void block_read (struct block *, block_sector_t, void *);
 void block_write (struct block *, block_sector_t, const void *);
+void block_read_multiple (struct block *, block_sector_t, size_t cnt, void *);
+void block_write_multiple (struct block *, block_sector_t, size_t cnt,
+                           const void *);
+void block_readv (struct block *, block_sector_t, size_t cnt,
+                  void *const buffers[]);
+void block_writev (struct block *, block_sector_t, size_t cnt,
+                   const void *const buffers[]);
 const char *block_name (struct block *);
 enum block_type block_type (struct block *);
 
+/* Asynchronous requests. */
+
+struct block_request;
+typedef void block_done_func (struct block_request *);
+
+/* A request to transfer CNT consecutive sectors starting at
+   SECTOR, each to or from its own buffer in BUFFERS.  The
+   submitter owns the request and the buffers until DONE is
+   called, which may happen in an interrupt handler, so DONE must
+   not sleep. */
+struct block_request
+{
+  struct list_elem elem; /* Element in a device's queue. */
+  block_sector_t sector; /* First sector. */
+  size_t cnt;            /* Number of sectors, 1...BLOCK_VEC_MAX. */
+  bool write;            /* Write to the device, or read from it? */
+  void *const *buffers;  /* One buffer per sector. */
+  block_done_func *done; /* Called when the transfer is complete. */
+  void *aux;             /* For use by DONE. */
+  int64_t deadline;      /* Timer tick by which the I/O scheduler
+                            should hand it to the driver. */
+};
+
+void block_request_init (struct block_request *, block_sector_t,
+                         size_t cnt, bool write, void *const buffers[],
+                         block_done_func *, void *aux);
+void block_submit (struct block *, struct block_request *);
+
+/* I/O scheduling. */
+void block_configure_scheduler (const char *name);
+
 /* Statistics. */
 void block_print_stats (void);
 
 /* Lower-level interface to block device drivers. */
 
+/* Most sectors passed to one call of a driver's READV or WRITEV
+   operation, and most sectors in one request. */
+#define BLOCK_VEC_MAX 64
+
+/* A driver either provides START and carries out requests itself,
+   or provides READ and WRITE, and perhaps READV and WRITEV, which
+   the block layer calls synchronously for each request. */
 struct block_operations
 {
   void (*read) (void *aux, block_sector_t, void *buffer);
   void (*write) (void *aux, block_sector_t, const void *buffer);
+
+  /* Optional.  Transfer CNT consecutive sectors, at most
+     BLOCK_VEC_MAX, starting at the given sector, each to or from
+     its own buffer in BUFFERS.  Drivers that leave these null get
+     one READ or WRITE call per sector instead. */
+  void (*readv) (void *aux, block_sector_t, size_t cnt,
+                 void *const buffers[]);
+  void (*writev) (void *aux, block_sector_t, size_t cnt,
+                  const void *const buffers[]);
+
+  /* Called with interrupts off whenever a request is added to the
+     device's queue.  The driver takes requests from the queue with
+     block_dequeue() once it is ready for them, and reports each one
+     finished with block_complete(), typically from its interrupt
+     handler. */
+  void (*start) (void *aux);
 };
 
+struct block_request *block_dequeue (struct block *);
+void block_complete (struct block_request *);
+
 struct block *block_register (const char *name, enum block_type,
                               const char *extra_info, block_sector_t size,
                               const struct block_operations *, void *aux);
@@ -1,17 +1,30 @@
 #include "devices/ide.h"
 #include <ctype.h>
 #include <debug.h>
+#include <round.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include "devices/block.h"
 #include "devices/partition.h"
+#include "devices/pci.h"
 #include "devices/timer.h"
 #include "threads/io.h"
 #include "threads/interrupt.h"
+#include "threads/palloc.h"
 #include "threads/synch.h"
+#include "threads/vaddr.h"
 
 /* The code in this file is an interface to an ATA (IDE)
-   controller.  It attempts to comply to [ATA-3]. */
+   controller.  It attempts to comply to [ATA-3].  If the PCI IDE
+   controller can master the bus, as the PIIX found in QEMU and
+   Bochs can, transfers use DMA and otherwise PIO.
+
+   Transfers are driven by interrupts.  The block layer queues
+   requests on each disk, and each channel carries out one request
+   at a time, since its two disks share its registers.  Starting a
+   request only programs the controller, and the interrupt handler
+   moves the data, completes the request, and starts the next one,
+   so that no thread needs to wait for the disk. */
 
 /* ATA command block port addresses. */
 #define reg_data(CHANNEL) ((CHANNEL)->reg_base + 0)   /* Data. */
@@ -34,6 +47,41 @@
 #define STA_BSY 0x80  /* Busy. */
 #define STA_DRDY 0x40 /* Device Ready. */
 #define STA_DRQ 0x08  /* Data Request. */
+#define STA_ERR 0x01  /* Error. */
+
+/* Bus master IDE port addresses, relative to the channel's
+   bus master base. */
+#define reg_bm_command(CHANNEL) ((CHANNEL)->bm_base + 0) /* Command. */
+#define reg_bm_status(CHANNEL) ((CHANNEL)->bm_base + 2)  /* Status. */
+#define reg_bm_prd(CHANNEL) ((CHANNEL)->bm_base + 4)     /* PRD table. */
+
+/* Bus master Command Register bits. */
+#define BM_CMD_START 0x01 /* Start transfer. */
+#define BM_CMD_READ 0x08  /* 1=write to memory, 0=read from memory. */
+
+/* Bus master Status Register bits.  Writing 1 clears ERR and INTR. */
+#define BM_STA_ERR 0x02  /* Transfer failed. */
+#define BM_STA_INTR 0x04 /* Device raised its interrupt. */
+
+/* PCI class and subclass of IDE controllers, and the
+   programming interface bits that we care about. */
+#define PCI_CLASS_STORAGE 0x01
+#define PCI_SUBCLASS_IDE 0x01
+#define PCI_IDE_NATIVE 0x05 /* Either channel in native mode. */
+#define PCI_IDE_MASTER 0x80 /* Bus master capable. */
+
+/* Physical Region Descriptor: one physically contiguous piece of
+   a DMA transfer.  A region may not cross a 64 kB boundary. */
+struct prd
+{
+  uint32_t addr;  /* Physical address. */
+  uint16_t size;  /* Byte count, with 0 meaning 64 kB. */
+  uint16_t flags; /* PRD_EOT in the table's last entry. */
+};
+
+#define PRD_EOT 0x8000       /* End of table. */
+#define PRD_BOUNDARY 0x10000 /* Regions stop at 64 kB. */
+#define PRD_CNT (PGSIZE / sizeof (struct prd)) /* Entries per table. */
 
 /* Control Register bits. */
 #define CTL_SRST 0x04 /* Software Reset. */
@@ -49,6 +97,11 @@
 #define CMD_IDENTIFY_DEVICE 0xec    /* IDENTIFY DEVICE. */
 #define CMD_READ_SECTOR_RETRY 0x20  /* READ SECTOR with retries. */
 #define CMD_WRITE_SECTOR_RETRY 0x30 /* WRITE SECTOR with retries. */
+#define CMD_READ_MULTIPLE 0xc4      /* READ MULTIPLE. */
+#define CMD_WRITE_MULTIPLE 0xc5     /* WRITE MULTIPLE. */
+#define CMD_SET_MULTIPLE_MODE 0xc6  /* SET MULTIPLE MODE. */
+#define CMD_READ_DMA 0xc8           /* READ DMA. */
+#define CMD_WRITE_DMA 0xca          /* WRITE DMA. */
 
 /* An ATA device. */
 struct ata_disk
@@ -57,6 +110,10 @@ struct ata_disk
   struct channel *channel; /* Channel that disk is attached to. */
   int dev_no;              /* Device 0 or 1 for master or slave. */
   bool is_ata;             /* Is device an ATA disk? */
+  int multiple;            /* Sectors moved per interrupt by READ and
+                              WRITE MULTIPLE, or 0 if not in use. */
+  bool dma;                /* Transfer by bus master DMA? */
+  struct block *block;     /* Block device, once registered. */
 };
 
 /* An ATA channel (aka controller).
@@ -66,11 +123,20 @@ struct channel
   char name[8];      /* Name, e.g. "ide0". */
   uint16_t reg_base; /* Base I/O port. */
   uint8_t irq;       /* Interrupt in use. */
+  uint16_t bm_base;  /* Bus master base I/O port, or 0 if none. */
+  struct prd *prd;   /* PRD table, one page, if BM_BASE is nonzero. */
 
-  struct lock lock;         /* Must acquire to access the controller. */
   bool expecting_interrupt; /* True if an interrupt is expected, false if
                                any interrupt would be spurious. */
-  struct semaphore completion_wait; /* Up'd by interrupt handler. */
+  struct semaphore completion_wait; /* Up'd by interrupt handler while
+                                       identifying disks. */
+
+  /* Request being carried out, if any.  Only used with interrupts
+     off. */
+  struct block_request *active; /* Active request or null. */
+  struct ata_disk *active_disk; /* Disk that ACTIVE is for. */
+  size_t xfer_cnt;              /* Sectors moved so far by PIO. */
+  bool active_dma;              /* Is ACTIVE moving by DMA? */
 
   struct ata_disk devices[2]; /* The devices on this channel. */
 };
@@ -81,14 +147,17 @@ static struct channel channels[CHANNEL_CNT];
 
 static struct block_operations ide_operations;
 
+static uint16_t find_bus_master (void);
 static void reset_channel (struct channel *);
 static bool check_device_type (struct ata_disk *);
 static void identify_ata_device (struct ata_disk *);
 
-static void select_sector (struct ata_disk *, block_sector_t);
+static void select_sector (struct ata_disk *, block_sector_t, size_t cnt);
 static void issue_pio_command (struct channel *, uint8_t command);
 static void input_sector (struct channel *, void *);
 static void output_sector (struct channel *, const void *);
+static bool build_prd_table (struct channel *, size_t cnt,
+                             void *const buffers[]);
 
 static void wait_until_idle (const struct ata_disk *);
 static bool wait_while_busy (const struct ata_disk *);
@@ -100,6 +169,7 @@ static void interrupt_handler (struct intr_frame *);
 /* Initialize the disk subsystem and detect disks. */
 void ide_init (void)
 {
+  uint16_t bm_base = find_bus_master ();
   size_t chan_no;
 
   for (chan_no = 0; chan_no < CHANNEL_CNT; chan_no++)
@@ -122,9 +192,17 @@ void ide_init (void)
           default:
             NOT_REACHED ();
         }
-      lock_init (&c->lock);
+      c->bm_base = 0;
+      c->prd = NULL;
+      if (bm_base != 0)
+        {
+          c->prd = palloc_get_page (0);
+          if (c->prd != NULL)
+            c->bm_base = bm_base + chan_no * 8;
+        }
       c->expecting_interrupt = false;
       sema_init (&c->completion_wait, 0);
+      c->active = NULL;
 
       /* Initialize devices. */
       for (dev_no = 0; dev_no < 2; dev_no++)
@@ -135,6 +213,9 @@ void ide_init (void)
           d->channel = c;
           d->dev_no = dev_no;
           d->is_ata = false;
+          d->multiple = 0;
+          d->dma = false;
+          d->block = NULL;
         }
 
       /* Register interrupt handler. */
@@ -157,6 +238,36 @@ void ide_init (void)
 /* Disk detection and identification. */
 
 static char *descramble_ata_string (char *, int size);
+static void set_multiple_mode (struct ata_disk *, int max_multiple);
+
+/* Looks for a PCI IDE controller that can master the bus and
+   whose channels are at the legacy ports that we use.  If one is
+   found, enables bus mastering and returns its bus master base
+   I/O port.  Otherwise returns 0, leaving all transfers to PIO. */
+static uint16_t find_bus_master (void)
+{
+  struct pci_address a;
+  uint32_t prog_if, bar, command;
+
+  if (!pci_find_class (PCI_CLASS_STORAGE, PCI_SUBCLASS_IDE, &a))
+    return 0;
+  prog_if = (pci_read_config (&a, PCI_REG_CLASS) >> 8) & 0xff;
+  if ((prog_if & PCI_IDE_MASTER) == 0 || (prog_if & PCI_IDE_NATIVE) != 0)
+    return 0;
+
+  /* BAR 4 holds the bus master ports, which must be in I/O space. */
+  bar = pci_read_config (&a, PCI_REG_BAR0 + 4 * 4);
+  if ((bar & 1) == 0 || (bar & 0xfffc) == 0)
+    return 0;
+
+  /* Writing zeros to the status half leaves its bits alone. */
+  command = pci_read_config (&a, PCI_REG_COMMAND) & 0xffff;
+  pci_write_config (&a, PCI_REG_COMMAND,
+                    command | PCI_CMD_IO | PCI_CMD_MASTER);
+
+  printf ("ide: bus master DMA at port 0x%04x\n", bar & 0xfffc);
+  return bar & 0xfffc;
+}
 
 /* Resets an ATA channel and waits for any devices present on it
    to finish the reset. */
@@ -259,7 +370,6 @@ static void identify_ata_device (struct ata_disk *d)
   block_sector_t capacity;
   char *model, *serial;
   char extra_info[128];
-  struct block *block;
 
   ASSERT (d->is_ata);
 
@@ -298,10 +408,40 @@ static void identify_ata_device (struct ata_disk *d)
       return;
     }
 
+  /* Move as many sectors per interrupt as the disk allows. */
+  set_multiple_mode (d, *(uint16_t *) &id[47 * 2] & 0xff);
+
+  /* Word 49 bit 8 says whether the disk supports DMA. */
+  d->dma = c->bm_base != 0 && (*(uint16_t *) &id[49 * 2] & 0x100) != 0;
+
   /* Register. */
-  block = block_register (d->name, BLOCK_RAW, extra_info, capacity,
-                          &ide_operations, d);
-  partition_scan (block);
+  d->block = block_register (d->name, BLOCK_RAW, extra_info, capacity,
+                             &ide_operations, d);
+  partition_scan (d->block);
+}
+
+/* Enables READ and WRITE MULTIPLE on disk D with the largest
+   power of 2 sectors per interrupt that is at most MAX_MULTIPLE,
+   the limit reported by IDENTIFY DEVICE.  Leaves them disabled if
+   MAX_MULTIPLE is 0 or the disk rejects the setting. */
+static void set_multiple_mode (struct ata_disk *d, int max_multiple)
+{
+  struct channel *c = d->channel;
+  int multiple;
+
+  d->multiple = 0;
+  if (max_multiple == 0)
+    return;
+  for (multiple = 1; multiple * 2 <= max_multiple; multiple *= 2)
+    continue;
+
+  select_device_wait (d);
+  outb (reg_nsect (c), multiple);
+  issue_pio_command (c, CMD_SET_MULTIPLE_MODE);
+  sema_down (&c->completion_wait);
+  wait_while_busy (d);
+  if ((inb (reg_alt_status (c)) & STA_ERR) == 0)
+    d->multiple = multiple;
 }
 
 /* Translates STRING, which consists of SIZE bytes in a funky
@@ -331,56 +471,166 @@ static char *descramble_ata_string (char *string, int size)
   return string;
 }
 
-/* Reads sector SEC_NO from disk D into BUFFER, which must have
-   room for BLOCK_SECTOR_SIZE bytes.
-   Internally synchronizes accesses to disks, so external
-   per-disk locking is unneeded. */
-static void ide_read (void *d_, block_sector_t sec_no, void *buffer)
+/* Disk transfers. */
+
+static void start_request (struct channel *, struct ata_disk *,
+                           struct block_request *);
+
+/* Starts the next request queued on channel C's disks, if any,
+   looking first at the disk other than D so that neither disk
+   can starve the other.  Interrupts must be off and C idle. */
+static void start_next (struct channel *c, struct ata_disk *d)
 {
-  struct ata_disk *d = d_;
-  struct channel *c = d->channel;
-  lock_acquire (&c->lock);
-  select_sector (d, sec_no);
-  issue_pio_command (c, CMD_READ_SECTOR_RETRY);
-  sema_down (&c->completion_wait);
-  if (!wait_while_busy (d))
-    PANIC ("%s: disk read failed, sector=%" PRDSNu, d->name, sec_no);
-  input_sector (c, buffer);
-  lock_release (&c->lock);
+  int i;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (c->active == NULL);
+
+  for (i = 1; i <= 2; i++)
+    {
+      struct ata_disk *next = &c->devices[(d->dev_no + i) % 2];
+      struct block_request *r;
+
+      if (next->block != NULL && (r = block_dequeue (next->block)) != NULL)
+        {
+          start_request (c, next, r);
+          return;
+        }
+    }
 }
 
-/* Write sector SEC_NO to disk D from BUFFER, which must contain
-   BLOCK_SECTOR_SIZE bytes.  Returns after the disk has
-   acknowledged receiving the data.
-   Internally synchronizes accesses to disks, so external
-   per-disk locking is unneeded. */
-static void ide_write (void *d_, block_sector_t sec_no, const void *buffer)
+/* Called by the block layer, with interrupts off, when a request
+   is queued on disk D.  Starts it unless D's channel is busy, in
+   which case the interrupt handler will get to it. */
+static void ide_start (void *d_)
 {
   struct ata_disk *d = d_;
-  struct channel *c = d->channel;
-  lock_acquire (&c->lock);
-  select_sector (d, sec_no);
-  issue_pio_command (c, CMD_WRITE_SECTOR_RETRY);
+
+  if (d->channel->active == NULL)
+    start_next (d->channel, d);
+}
+
+static struct block_operations ide_operations = {NULL, NULL, NULL, NULL,
+                                                 ide_start};
+
+/* Moves the next block of channel C's active PIO request between
+   the disk and memory: D->multiple sectors with READ or WRITE
+   MULTIPLE, otherwise one sector. */
+static void pio_block (struct channel *c)
+{
+  struct block_request *r = c->active;
+  struct ata_disk *d = c->active_disk;
+  size_t per_irq = d->multiple > 0 ? (size_t) d->multiple : 1;
+  size_t end = r->cnt - c->xfer_cnt > per_irq ? c->xfer_cnt + per_irq
+                                              : r->cnt;
+
   if (!wait_while_busy (d))
-    PANIC ("%s: disk write failed, sector=%" PRDSNu, d->name, sec_no);
-  output_sector (c, buffer);
-  sema_down (&c->completion_wait);
-  lock_release (&c->lock);
+    PANIC ("%s: disk %s failed, sector=%" PRDSNu, d->name,
+           r->write ? "write" : "read", r->sector + c->xfer_cnt);
+  for (; c->xfer_cnt < end; c->xfer_cnt++)
+    if (r->write)
+      output_sector (c, r->buffers[c->xfer_cnt]);
+    else
+      input_sector (c, r->buffers[c->xfer_cnt]);
+}
+
+/* Makes R, a request for disk D, the active request on idle
+   channel C and issues its command.  Uses DMA if D and R's
+   buffers allow it, and otherwise PIO.  For a PIO write, also
+   sends the first block of data.  Interrupts must be off. */
+static void start_request (struct channel *c, struct ata_disk *d,
+                           struct block_request *r)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  c->active = r;
+  c->active_disk = d;
+  c->xfer_cnt = 0;
+  c->active_dma = d->dma && build_prd_table (c, r->cnt, r->buffers);
+
+  select_sector (d, r->sector, r->cnt);
+  if (c->active_dma)
+    {
+      uint8_t direction = r->write ? 0 : BM_CMD_READ;
+
+      outl (reg_bm_prd (c), vtop (c->prd));
+      outb (reg_bm_command (c), direction);
+      outb (reg_bm_status (c),
+            inb (reg_bm_status (c)) | BM_STA_ERR | BM_STA_INTR);
+      outb (reg_command (c), r->write ? CMD_WRITE_DMA : CMD_READ_DMA);
+      outb (reg_bm_command (c), direction | BM_CMD_START);
+    }
+  else if (r->write)
+    {
+      outb (reg_command (c), d->multiple > 0 ? CMD_WRITE_MULTIPLE
+                                             : CMD_WRITE_SECTOR_RETRY);
+      pio_block (c);
+    }
+  else
+    outb (reg_command (c), d->multiple > 0 ? CMD_READ_MULTIPLE
+                                           : CMD_READ_SECTOR_RETRY);
 }
 
-static struct block_operations ide_operations = {ide_read, ide_write};
+/* Handles an interrupt for channel C's active request: moves the
+   next block of a PIO transfer, or finishes a DMA transfer.  Once
+   the request is done, completes it and starts the next one.  If
+   a DMA transfer fails, stops using DMA for the disk and starts
+   the request over by PIO. */
+static void continue_request (struct channel *c)
+{
+  struct block_request *r = c->active;
+  struct ata_disk *d = c->active_disk;
+
+  if (c->active_dma)
+    {
+      uint8_t bm_status;
+
+      outb (reg_bm_command (c), r->write ? 0 : BM_CMD_READ);
+      bm_status = inb (reg_bm_status (c));
+      outb (reg_bm_status (c), bm_status | BM_STA_ERR | BM_STA_INTR);
+      if ((bm_status & BM_STA_ERR) != 0 ||
+          (inb (reg_alt_status (c)) & STA_ERR) != 0)
+        {
+          printf ("%s: DMA failed, sector=%" PRDSNu ", using PIO\n",
+                  d->name, r->sector);
+          d->dma = false;
+          start_request (c, d, r);
+          return;
+        }
+    }
+  else if (!r->write)
+    {
+      pio_block (c);
+      if (c->xfer_cnt < r->cnt)
+        return;
+    }
+  else if (c->xfer_cnt < r->cnt)
+    {
+      pio_block (c);
+      return;
+    }
+
+  /* Completing R may already start another request. */
+  c->active = NULL;
+  block_complete (r);
+  if (c->active == NULL)
+    start_next (c, d);
+}
 
 /* Selects device D, waiting for it to become ready, and then
-   writes SEC_NO to the disk's sector selection registers.  (We
-   use LBA mode.) */
-static void select_sector (struct ata_disk *d, block_sector_t sec_no)
+   writes SEC_NO and the number of sectors CNT, which must be
+   between 1 and 256, to the disk's sector selection registers.
+   (We use LBA mode.) */
+static void select_sector (struct ata_disk *d, block_sector_t sec_no,
+                           size_t cnt)
 {
   struct channel *c = d->channel;
 
   ASSERT (sec_no < (1UL << 28));
+  ASSERT (cnt >= 1 && cnt <= 256 && cnt <= (1UL << 28) - sec_no);
 
   select_device_wait (d);
-  outb (reg_nsect (c), 1);
+  outb (reg_nsect (c), cnt); /* 256 is written as 0. */
   outb (reg_lbal (c), sec_no);
   outb (reg_lbam (c), sec_no >> 8);
   outb (reg_lbah (c), (sec_no >> 16));
@@ -414,6 +664,48 @@ static void output_sector (struct channel *c, const void *sector)
   outsw (reg_data (c), sector, BLOCK_SECTOR_SIZE / 2);
 }
 
+/* Fills channel C's PRD table with the physical regions of the
+   CNT sector buffers in BUFFERS, merging regions that are
+   physically contiguous.  Returns false, leaving the transfer to
+   PIO, if some buffer is not word-aligned kernel memory. */
+static bool build_prd_table (struct channel *c, size_t cnt,
+                             void *const buffers[])
+{
+  struct prd *prd = c->prd;
+  size_t n = 0;
+  size_t i;
+
+  for (i = 0; i < cnt; i++)
+    {
+      uintptr_t addr, end;
+
+      if (!is_kernel_vaddr (buffers[i]) || (uintptr_t) buffers[i] % 2 != 0)
+        return false;
+      addr = vtop (buffers[i]);
+      end = addr + BLOCK_SECTOR_SIZE;
+      while (addr < end)
+        {
+          uintptr_t limit = ROUND_DOWN (addr, PRD_BOUNDARY) + PRD_BOUNDARY;
+          size_t size = (end < limit ? end : limit) - addr;
+
+          if (n > 0 && addr % PRD_BOUNDARY != 0 &&
+              prd[n - 1].addr + prd[n - 1].size == addr)
+            prd[n - 1].size += size;
+          else
+            {
+              ASSERT (n < PRD_CNT);
+              prd[n].addr = addr;
+              prd[n].size = size;
+              prd[n].flags = 0;
+              n++;
+            }
+          addr += size;
+        }
+    }
+  prd[n - 1].flags = PRD_EOT;
+  return true;
+}
+
 /* Low-level ATA primitives. */
 
 /* Wait up to 10 seconds for the controller to become idle, that
@@ -429,7 +721,12 @@ static void wait_until_idle (const struct ata_disk *d)
     {
       if ((inb (reg_status (d->channel)) & (STA_BSY | STA_DRQ)) == 0)
         return;
-      timer_usleep (10);
+      /* start_request() runs with interrupts off, where sleeping
+         is not allowed. */
+      if (intr_get_level () == INTR_ON)
+        timer_usleep (10);
+      else
+        timer_udelay (10);
     }
 
   printf ("%s: idle timeout\n", d->name);
@@ -454,7 +751,12 @@ static bool wait_while_busy (const struct ata_disk *d)
             printf ("ok\n");
           return (inb (reg_alt_status (c)) & STA_DRQ) != 0;
         }
-      timer_msleep (10);
+      /* The interrupt handler starts requests, so it cannot
+         sleep. */
+      if (intr_get_level () == INTR_ON)
+        timer_msleep (10);
+      else
+        timer_mdelay (10);
     }
 
   printf ("failed\n");
@@ -470,7 +772,10 @@ static void select_device (const struct ata_disk *d)
     dev |= DEV_DEV;
   outb (reg_device (c), dev);
   inb (reg_alt_status (c));
-  timer_nsleep (400);
+  if (intr_get_level () == INTR_ON)
+    timer_nsleep (400);
+  else
+    timer_ndelay (400);
 }
 
 /* Select disk D in its channel, as select_device(), but wait for
@@ -490,7 +795,12 @@ static void interrupt_handler (struct intr_frame *f)
   for (c = channels; c < channels + CHANNEL_CNT; c++)
     if (f->vec_no == c->irq)
       {
-        if (c->expecting_interrupt)
+        if (c->active != NULL)
+          {
+            inb (reg_status (c)); /* Acknowledge interrupt. */
+            continue_request (c);
+          }
+        else if (c->expecting_interrupt)
           {
             inb (reg_status (c));          /* Acknowledge interrupt. */
             sema_up (&c->completion_wait); /* Wake up waiter. */
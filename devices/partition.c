@@ -11,6 +11,7 @@ struct partition
 {
   struct block *block;  /* Underlying block device. */
   block_sector_t start; /* First sector within device. */
+  struct block *self;   /* The partition's own block device. */
 };
 
 static struct block_operations partition_operations;
@@ -178,7 +179,8 @@ static void found_partition (struct block *block, uint8_t part_type,
       snprintf (name, sizeof name, "%s%d", block_name (block), part_nr);
       snprintf (extra_info, sizeof extra_info, "%s (%02x)",
                 partition_type_name (part_type), part_type);
-      block_register (name, type, extra_info, size, &partition_operations, p);
+      p->self = block_register (name, type, extra_info, size,
+                                &partition_operations, p);
     }
 }
 
@@ -293,23 +295,20 @@ static const char *partition_type_name (uint8_t type)
   return type_names[type] != NULL ? type_names[type] : "Unknown";
 }
 
-/* Reads sector SECTOR from partition P into BUFFER, which must
-   have room for BLOCK_SECTOR_SIZE bytes. */
-static void partition_read (void *p_, block_sector_t sector, void *buffer)
+/* Passes each request queued on partition P on to the
+   underlying device, translated to the device's sectors.  The
+   device's driver completes it. */
+static void partition_start (void *p_)
 {
   struct partition *p = p_;
-  block_read (p->block, p->start + sector, buffer);
-}
+  struct block_request *r;
 
-/* Write sector SECTOR to partition P from BUFFER, which must
-   contain BLOCK_SECTOR_SIZE bytes.  Returns after the block has
-   acknowledged receiving the data. */
-static void partition_write (void *p_, block_sector_t sector,
-                             const void *buffer)
-{
-  struct partition *p = p_;
-  block_write (p->block, p->start + sector, buffer);
+  while ((r = block_dequeue (p->self)) != NULL)
+    {
+      r->sector += p->start;
+      block_submit (p->block, r);
+    }
 }
 
-static struct block_operations partition_operations = {partition_read,
-                                                       partition_write};
+static struct block_operations partition_operations = {NULL, NULL, NULL,
+                                                       NULL, partition_start};
@@ -0,0 +1,71 @@
+#include "devices/pci.h"
+#include "threads/io.h"
+
+/* This code reads and writes PCI configuration space through
+   configuration mechanism #1, which every PC chipset that Pintos
+   runs on supports.  It does just enough to find a device by
+   class and program it. */
+
+/* Configuration mechanism #1 I/O ports. */
+#define PCI_CONFIG_ADDRESS 0xcf8 /* Selects a function and register. */
+#define PCI_CONFIG_DATA 0xcfc    /* Reads or writes the selected dword. */
+
+/* Selects register REG of the function at A. */
+static void select_register (const struct pci_address *a, int reg)
+{
+  outl (PCI_CONFIG_ADDRESS, 0x80000000 | (a->bus << 16) | (a->dev << 11) |
+                                (a->func << 8) | (reg & 0xfc));
+}
+
+/* Returns the dword at offset REG in the configuration space of
+   the function at A. */
+uint32_t pci_read_config (const struct pci_address *a, int reg)
+{
+  select_register (a, reg);
+  return inl (PCI_CONFIG_DATA);
+}
+
+/* Writes VALUE to the dword at offset REG in the configuration
+   space of the function at A. */
+void pci_write_config (const struct pci_address *a, int reg, uint32_t value)
+{
+  select_register (a, reg);
+  outl (PCI_CONFIG_DATA, value);
+}
+
+/* Searches every bus for the first function with the given CLASS
+   and SUBCLASS codes.  If one is found, stores its location in *A
+   and returns true.  Otherwise returns false. */
+bool pci_find_class (uint8_t class, uint8_t subclass, struct pci_address *a)
+{
+  int bus, dev, func;
+
+  for (bus = 0; bus < 256; bus++)
+    for (dev = 0; dev < 32; dev++)
+      for (func = 0; func < 8; func++)
+        {
+          uint32_t class_reg;
+
+          a->bus = bus;
+          a->dev = dev;
+          a->func = func;
+          if ((pci_read_config (a, PCI_REG_ID) & 0xffff) == 0xffff)
+            {
+              /* No function here.  Function 0 is always present in
+                 a device that has any. */
+              if (func == 0)
+                break;
+              continue;
+            }
+
+          class_reg = pci_read_config (a, PCI_REG_CLASS);
+          if ((class_reg >> 24) == class &&
+              ((class_reg >> 16) & 0xff) == subclass)
+            return true;
+
+          /* Only multifunction devices have functions 1...7. */
+          if (func == 0 && !(pci_read_config (a, PCI_REG_HEADER) & 0x800000))
+            break;
+        }
+  return false;
+}
@@ -23,38 +23,46 @@ static bool list_dir (const char *dir, bool verbose)
 
   if (isdir (dir_fd))
     {
-      char name[READDIR_MAX_LEN];
+      struct dirent entries[16];
+      int cnt;
 
       printf ("%s", dir);
       if (verbose)
         printf (" (inumber %d)", inumber (dir_fd));
       printf (":\n");
 
-      while (readdir (dir_fd, name))
+      while ((cnt = getdents (dir_fd, entries, 16)) > 0)
         {
-          printf ("%s", name);
-          if (verbose)
-            {
-              char full_name[128];
-              int entry_fd;
+          int i;
 
-              snprintf (full_name, sizeof full_name, "%s/%s", dir, name);
-              entry_fd = open (full_name);
+          for (i = 0; i < cnt; i++)
+            {
+              struct dirent *e = &entries[i];
 
-              printf (": ");
-              if (entry_fd != -1)
+              printf ("%s", e->name);
+              if (verbose)
                 {
-                  if (isdir (entry_fd))
+                  printf (": ");
+                  if (e->is_dir)
                     printf ("directory");
                   else
-                    printf ("%d-byte file", filesize (entry_fd));
-                  printf (", inumber %d", inumber (entry_fd));
+                    {
+                      char full_name[128];
+                      int entry_fd;
+
+                      snprintf (full_name, sizeof full_name, "%s/%s", dir,
+                                e->name);
+                      entry_fd = open (full_name);
+                      if (entry_fd != -1)
+                        printf ("%d-byte file", filesize (entry_fd));
+                      else
+                        printf ("open failed");
+                      close (entry_fd);
+                    }
+                  printf (", inumber %d", e->inumber);
                 }
-              else
-                printf ("open failed");
-              close (entry_fd);
+              printf ("\n");
             }
-          printf ("\n");
         }
     }
   else
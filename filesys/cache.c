@@ -0,0 +1,723 @@
+#include "filesys/cache.h"
+#include <debug.h>
+#include <hash.h>
+#include <round.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "devices/timer.h"
+#include "filesys/filesys.h"
+#include "filesys/journal.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+
+/* Sector number of a cache entry that holds no sector. */
+#define CACHE_NO_SECTOR ((block_sector_t) -1)
+
+/* A sector held in the buffer cache. */
+struct cache_entry
+{
+  struct cache_entry *next; /* Next entry in the same cache_map bucket. */
+  block_sector_t sector;  /* Cached sector, or CACHE_NO_SECTOR. */
+  bool dirty;             /* True if DATA differs from the disk. */
+  int64_t dirty_tick;     /* Timer tick at which DIRTY became true. */
+  bool meta;              /* Holds changes not yet committed to the
+                             journal, so it must not be written. */
+  bool committing;        /* Being committed to the journal, so it must
+                             not be written yet. */
+  bool accessed;          /* Recently used, for clock eviction. */
+  int pin_cnt;            /* Number of threads using this entry. */
+  struct lock data_lock;  /* Held while reading or writing DATA. */
+  uint8_t *data;          /* BLOCK_SECTOR_SIZE bytes of sector data. */
+};
+
+/* Number of entries requested on the command line. */
+static size_t cache_sectors = CACHE_DEFAULT_SECTORS;
+
+static struct cache_entry *entries; /* All cache entries. */
+static size_t entry_cnt;            /* Number of entries. */
+static size_t clock_hand;           /* Next eviction candidate. */
+
+/* Maps sector numbers to entries.  The number of buckets is fixed
+   at initialization, because the number of cached sectors only
+   changes by one around each eviction, which would make a hash
+   table that resizes itself rehash on every miss. */
+static struct cache_entry **cache_map;
+static size_t bucket_cnt; /* Number of buckets, a power of 2. */
+
+static size_t dirty_cnt;            /* Number of dirty entries. */
+static size_t meta_cnt;             /* Number of entries with META set. */
+
+/* Writers of metadata commit the journal first once more than
+   META_HIGH_WATER entries hold uncommitted changes.  This leaves
+   eviction plenty of other entries to choose from and keeps each
+   transaction well within the journal. */
+#define META_HIGH_WATER(CNT)                                                   \
+  ((CNT) / 4 < JOURNAL_SECTORS / 2 ? (CNT) / 4 : JOURNAL_SECTORS / 2)
+
+/* Entries gathered by cache_begin_commit().  Serialized by the
+   journal. */
+static struct cache_entry **commit_batch;
+static size_t commit_cnt;
+
+/* Protects cache_map, clock_hand, dirty_cnt, meta_cnt and the
+   SECTOR, ACCESSED, PIN_CNT, DIRTY_TICK and COMMITTING members of
+   every entry.  An entry's DIRTY and META members only change while
+   the entry is pinned and its data lock is held, except that
+   cache_begin_commit() clears META. */
+static struct lock cache_lock;
+
+/* Signaled when an entry's PIN_CNT drops to zero. */
+static struct condition cache_unpinned;
+
+/* Sectors waiting to be prefetched by the read-ahead thread.
+   Requests that do not fit are dropped, since read-ahead is only
+   a hint. */
+#define READAHEAD_QUEUE_SIZE 64
+static block_sector_t readahead_queue[READAHEAD_QUEUE_SIZE];
+static size_t readahead_head; /* Index of oldest request. */
+static size_t readahead_cnt;  /* Number of queued requests. */
+static struct lock readahead_lock;
+static struct condition readahead_ready; /* Signaled on new requests. */
+
+/* The flusher thread wakes up every FLUSH_TICKS timer ticks and
+   writes back sectors that have been dirty for at least
+   FLUSH_MAX_AGE ticks, or every dirty sector once more than
+   FLUSH_HIGH_WATER of the cache is dirty. */
+#define FLUSH_TICKS (TIMER_FREQ / 4)
+#define FLUSH_MAX_AGE TIMER_FREQ
+#define FLUSH_HIGH_WATER(CNT) ((CNT) / 2)
+
+/* Entries collected for one write-back batch, sorted by sector.
+   Serialized by flush_lock. */
+static struct cache_entry **flush_batch;
+static struct lock flush_lock;
+
+/* Statistics. */
+static unsigned long long hit_cnt, miss_cnt, writeback_cnt, prefetch_cnt;
+
+static thread_func readahead_thread NO_RETURN;
+static thread_func flusher_thread NO_RETURN;
+
+/* Returns the cache_map bucket for SECTOR. */
+static struct cache_entry **cache_bucket (block_sector_t sector)
+{
+  return &cache_map[hash_int (sector) & (bucket_cnt - 1)];
+}
+
+/* Adds entry E to cache_map.  The cache lock must be held. */
+static void cache_map_insert (struct cache_entry *e)
+{
+  struct cache_entry **bucket = cache_bucket (e->sector);
+  e->next = *bucket;
+  *bucket = e;
+}
+
+/* Removes entry E from cache_map.  The cache lock must be held. */
+static void cache_map_remove (struct cache_entry *e)
+{
+  struct cache_entry **p;
+
+  for (p = cache_bucket (e->sector); *p != e; p = &(*p)->next)
+    ASSERT (*p != NULL);
+  *p = e->next;
+}
+
+/* Sets the number of sectors the buffer cache will hold.  Must be
+   called before cache_init(). */
+void cache_configure (size_t sectors)
+{
+  if (sectors == 0)
+    PANIC ("buffer cache must hold at least one sector");
+  cache_sectors = sectors;
+}
+
+/* Initializes the buffer cache. */
+void cache_init (void)
+{
+  size_t i;
+  uint8_t *data;
+
+  entry_cnt = cache_sectors;
+  for (bucket_cnt = 1; bucket_cnt < entry_cnt; bucket_cnt *= 2)
+    continue;
+  cache_map = calloc (bucket_cnt, sizeof *cache_map);
+  entries = calloc (entry_cnt, sizeof *entries);
+  flush_batch = calloc (entry_cnt, sizeof *flush_batch);
+  commit_batch = calloc (entry_cnt, sizeof *commit_batch);
+  data = palloc_get_multiple (
+      PAL_ZERO, DIV_ROUND_UP (entry_cnt * BLOCK_SECTOR_SIZE, PGSIZE));
+  if (entries == NULL || flush_batch == NULL || commit_batch == NULL ||
+      cache_map == NULL || data == NULL)
+    PANIC ("couldn't allocate %zu-sector buffer cache", entry_cnt);
+
+  for (i = 0; i < entry_cnt; i++)
+    {
+      struct cache_entry *e = &entries[i];
+      e->sector = CACHE_NO_SECTOR;
+      lock_init (&e->data_lock);
+      e->data = data + i * BLOCK_SECTOR_SIZE;
+    }
+  clock_hand = 0;
+  dirty_cnt = 0;
+  meta_cnt = 0;
+  commit_cnt = 0;
+  lock_init (&cache_lock);
+  cond_init (&cache_unpinned);
+  lock_init (&flush_lock);
+
+  readahead_head = readahead_cnt = 0;
+  lock_init (&readahead_lock);
+  cond_init (&readahead_ready);
+  thread_create ("read-ahead", PRI_DEFAULT, readahead_thread, NULL);
+  thread_create ("flusher", PRI_DEFAULT, flusher_thread, NULL);
+}
+
+/* Returns the entry holding SECTOR, or a null pointer if SECTOR is
+   not cached.  The cache lock must be held. */
+static struct cache_entry *cache_lookup (block_sector_t sector)
+{
+  struct cache_entry *e;
+
+  for (e = *cache_bucket (sector); e != NULL; e = e->next)
+    if (e->sector == sector)
+      return e;
+  return NULL;
+}
+
+/* Releases E's data lock and unpins it.  The cache lock must be
+   held. */
+static void cache_unpin (struct cache_entry *e)
+{
+  lock_release (&e->data_lock);
+  if (--e->pin_cnt == 0)
+    cond_signal (&cache_unpinned, &cache_lock);
+}
+
+/* Picks an unpinned entry to reuse with the clock algorithm,
+   writing it back to disk first if it is dirty, and removes it
+   from cache_map.  Entries waiting for the journal are passed
+   over.  Waits for an entry to be unpinned if every entry is in
+   use.  The cache lock must be held, but is released while a dirty
+   victim is written, so other threads may change the cache
+   meanwhile. */
+static struct cache_entry *cache_evict (void)
+{
+  ASSERT (lock_held_by_current_thread (&cache_lock));
+  for (;;)
+    {
+      struct cache_entry *victim = NULL;
+
+      while (victim == NULL)
+        {
+          size_t i;
+
+          /* Two sweeps are enough to clear every accessed bit. */
+          for (i = 0; i < 2 * entry_cnt; i++)
+            {
+              struct cache_entry *e = &entries[clock_hand];
+              clock_hand = (clock_hand + 1) % entry_cnt;
+              if (e->pin_cnt > 0 || e->meta || e->committing)
+                continue;
+              if (e->accessed)
+                e->accessed = false;
+              else
+                {
+                  victim = e;
+                  break;
+                }
+            }
+          if (victim == NULL)
+            cond_wait (&cache_unpinned, &cache_lock);
+        }
+
+      if (!victim->dirty)
+        {
+          if (victim->sector != CACHE_NO_SECTOR)
+            cache_map_remove (victim);
+          victim->sector = CACHE_NO_SECTOR;
+          return victim;
+        }
+
+      /* Write VICTIM back without the cache lock, as
+         cache_write_back() does, so that hits and other misses
+         need not wait for the disk.  Pinning keeps it in cache_map
+         for readers of its sector, which wait for the data lock.
+         See cache_write_back() for why META and COMMITTING may be
+         tested here.  Afterward VICTIM is only reused if nobody
+         used or changed it meanwhile; otherwise the search goes
+         on. */
+      victim->pin_cnt++;
+      lock_release (&cache_lock);
+      lock_acquire (&victim->data_lock);
+      if (victim->dirty && !victim->meta && !victim->committing)
+        {
+          block_write (fs_device, victim->sector, victim->data);
+          lock_acquire (&cache_lock);
+          victim->dirty = false;
+          dirty_cnt--;
+          writeback_cnt++;
+        }
+      else
+        lock_acquire (&cache_lock);
+      cache_unpin (victim);
+    }
+}
+
+/* Assigns an evicted entry to SECTOR and returns it pinned and
+   with its data lock held.  Returns a null pointer instead if
+   another thread cached SECTOR while an eviction had the cache
+   lock released.  The cache lock must be held; it is released
+   before returning an entry, but not before returning a null
+   pointer. */
+static struct cache_entry *cache_install (block_sector_t sector)
+{
+  struct cache_entry *e = cache_evict ();
+
+  if (cache_lookup (sector) != NULL)
+    return NULL;
+
+  e->sector = sector;
+  e->pin_cnt = 1;
+  cache_map_insert (e);
+
+  /* Take the data lock before dropping the cache lock so that
+     other threads finding E wait until its data is valid. */
+  lock_acquire (&e->data_lock);
+  lock_release (&cache_lock);
+  return e;
+}
+
+/* Returns the entry for SECTOR, pinned and with its data lock
+   held.  If SECTOR is not cached, it is loaded from disk unless
+   LOAD is false, in which case the caller must overwrite the
+   whole sector. */
+static struct cache_entry *cache_get (block_sector_t sector, bool load)
+{
+  struct cache_entry *e;
+
+  ASSERT (sector != CACHE_NO_SECTOR);
+
+  lock_acquire (&cache_lock);
+  do
+    {
+      e = cache_lookup (sector);
+      if (e != NULL)
+        {
+          hit_cnt++;
+          e->pin_cnt++;
+          lock_release (&cache_lock);
+
+          /* If another thread is still loading the sector, this
+             waits for it to finish. */
+          lock_acquire (&e->data_lock);
+          return e;
+        }
+      e = cache_install (sector);
+    }
+  while (e == NULL);
+
+  miss_cnt++;
+  if (load)
+    block_read (fs_device, sector, e->data);
+  return e;
+}
+
+/* Releases entry E obtained from cache_get(), marking it dirty if
+   DIRTY is true, and as holding uncommitted metadata if META is
+   also true. */
+static void cache_put (struct cache_entry *e, bool dirty, bool meta)
+{
+  lock_acquire (&cache_lock);
+  e->accessed = true;
+  if (dirty && !e->dirty)
+    {
+      e->dirty = true;
+      e->dirty_tick = timer_ticks ();
+      dirty_cnt++;
+    }
+  if (dirty && meta && !e->meta)
+    {
+      e->meta = true;
+      meta_cnt++;
+    }
+  cache_unpin (e);
+  lock_release (&cache_lock);
+}
+
+/* Loads SECTOR into the cache if it is not already there.  The
+   entry is left with its accessed bit clear, so a prefetched
+   sector that is never used is among the first to be evicted. */
+static void cache_prefetch (block_sector_t sector)
+{
+  struct cache_entry *e;
+
+  lock_acquire (&cache_lock);
+  if (cache_lookup (sector) != NULL)
+    {
+      lock_release (&cache_lock);
+      return;
+    }
+  e = cache_install (sector);
+  if (e == NULL)
+    {
+      lock_release (&cache_lock);
+      return;
+    }
+  prefetch_cnt++;
+  block_read (fs_device, sector, e->data);
+
+  lock_acquire (&cache_lock);
+  cache_unpin (e);
+  lock_release (&cache_lock);
+}
+
+/* Asks the read-ahead thread to load SECTOR into the cache in the
+   background.  Returns without waiting; the request is ignored if
+   the read-ahead queue is full. */
+void cache_readahead (block_sector_t sector)
+{
+  lock_acquire (&readahead_lock);
+  if (readahead_cnt < READAHEAD_QUEUE_SIZE)
+    {
+      size_t tail = (readahead_head + readahead_cnt) % READAHEAD_QUEUE_SIZE;
+      readahead_queue[tail] = sector;
+      readahead_cnt++;
+      cond_signal (&readahead_ready, &readahead_lock);
+    }
+  lock_release (&readahead_lock);
+}
+
+/* Read-ahead thread.  Prefetches queued sectors in the order they
+   were requested. */
+static void readahead_thread (void *aux UNUSED)
+{
+  for (;;)
+    {
+      block_sector_t sector;
+
+      lock_acquire (&readahead_lock);
+      while (readahead_cnt == 0)
+        cond_wait (&readahead_ready, &readahead_lock);
+      sector = readahead_queue[readahead_head];
+      readahead_head = (readahead_head + 1) % READAHEAD_QUEUE_SIZE;
+      readahead_cnt--;
+      lock_release (&readahead_lock);
+
+      cache_prefetch (sector);
+    }
+}
+
+/* Reads SIZE bytes starting at byte OFS within SECTOR into
+   BUFFER. */
+void cache_read_at (block_sector_t sector, void *buffer, off_t ofs,
+                    off_t size)
+{
+  struct cache_entry *e;
+
+  ASSERT (ofs >= 0 && size >= 0 && ofs + size <= BLOCK_SECTOR_SIZE);
+
+  e = cache_get (sector, true);
+  memcpy (buffer, e->data + ofs, size);
+  cache_put (e, false, false);
+}
+
+/* Writes SIZE bytes from BUFFER into SECTOR, starting at byte OFS
+   within the sector.  The data reaches the disk when the flusher
+   thread writes it back, the entry is evicted or the cache is
+   flushed.  If META is true, SECTOR holds metadata, which is
+   committed to the journal before it is written in place. */
+void cache_write_at (block_sector_t sector, const void *buffer, off_t ofs,
+                     off_t size, bool meta)
+{
+  struct cache_entry *e;
+  bool logged;
+
+  ASSERT (ofs >= 0 && size >= 0 && ofs + size <= BLOCK_SECTOR_SIZE);
+
+  logged = journal_begin (sector, meta);
+  /* A write that covers the whole sector need not read it. */
+  e = cache_get (sector, size < BLOCK_SECTOR_SIZE);
+  memcpy (e->data + ofs, buffer, size);
+  cache_put (e, true, logged);
+  journal_end (logged);
+}
+
+/* Writes SIZE bytes from BUFFER into SECTOR, starting at byte OFS
+   within the sector, and zeroes the rest of the sector.  The old
+   contents are never read from disk, so this is the way to write
+   to a sector that holds no data yet.  META is as for
+   cache_write_at(). */
+void cache_write_new (block_sector_t sector, const void *buffer, off_t ofs,
+                      off_t size, bool meta)
+{
+  struct cache_entry *e;
+  bool logged;
+
+  ASSERT (ofs >= 0 && size >= 0 && ofs + size <= BLOCK_SECTOR_SIZE);
+
+  logged = journal_begin (sector, meta);
+  e = cache_get (sector, false);
+  memset (e->data, 0, ofs);
+  memcpy (e->data + ofs, buffer, size);
+  memset (e->data + ofs + size, 0, BLOCK_SECTOR_SIZE - ofs - size);
+  cache_put (e, true, logged);
+  journal_end (logged);
+}
+
+/* Sets every byte of SECTOR to BYTE without reading it from
+   disk.  META is as for cache_write_at(). */
+void cache_fill (block_sector_t sector, int byte, bool meta)
+{
+  bool logged = journal_begin (sector, meta);
+  struct cache_entry *e = cache_get (sector, false);
+  memset (e->data, byte, BLOCK_SECTOR_SIZE);
+  cache_put (e, true, logged);
+  journal_end (logged);
+}
+
+/* Reads SECTOR into BUFFER, which must have room for
+   BLOCK_SECTOR_SIZE bytes. */
+void cache_read (block_sector_t sector, void *buffer)
+{
+  cache_read_at (sector, buffer, 0, BLOCK_SECTOR_SIZE);
+}
+
+/* Writes BLOCK_SECTOR_SIZE bytes from BUFFER into SECTOR.  META
+   is as for cache_write_at(). */
+void cache_write (block_sector_t sector, const void *buffer, bool meta)
+{
+  cache_write_at (sector, buffer, 0, BLOCK_SECTOR_SIZE, meta);
+}
+
+/* Orders pointers to cache entries by sector number. */
+static int compare_sectors (const void *a_, const void *b_)
+{
+  const struct cache_entry *a = *(struct cache_entry *const *) a_;
+  const struct cache_entry *b = *(struct cache_entry *const *) b_;
+  return a->sector < b->sector ? -1 : a->sector > b->sector;
+}
+
+/* Entries of the run being gathered by cache_write_back(), with
+   consecutive sectors, and their data.  Serialized by flush_lock. */
+static struct cache_entry *flush_run[BLOCK_VEC_MAX];
+static const void *flush_run_data[BLOCK_VEC_MAX];
+
+/* Writes the CNT entries in flush_run, whose data locks are held,
+   to disk with one request, then marks them clean, releases their
+   data locks and unpins them. */
+static void write_run (size_t cnt)
+{
+  size_t i;
+
+  if (cnt == 0)
+    return;
+  for (i = 0; i < cnt; i++)
+    flush_run_data[i] = flush_run[i]->data;
+  block_writev (fs_device, flush_run[0]->sector, cnt, flush_run_data);
+
+  lock_acquire (&cache_lock);
+  for (i = 0; i < cnt; i++)
+    {
+      struct cache_entry *e = flush_run[i];
+      e->dirty = false;
+      dirty_cnt--;
+      writeback_cnt++;
+      cache_unpin (e);
+    }
+  lock_release (&cache_lock);
+}
+
+/* Writes back every sector that became dirty at or before timer
+   tick DEADLINE, in ascending sector order so that the disk sees
+   one sweep instead of scattered seeks.  Runs of consecutive
+   sectors go to the disk as one request each.  Sectors waiting for
+   the journal are skipped.  Returns the number of sectors
+   written. */
+static size_t cache_write_back (int64_t deadline)
+{
+  size_t batch_cnt = 0;
+  size_t run_cnt = 0;
+  size_t i;
+
+  lock_acquire (&flush_lock);
+
+  /* Pin the candidates so that they cannot be evicted, which also
+     keeps their sector numbers stable while sorting. */
+  lock_acquire (&cache_lock);
+  for (i = 0; i < entry_cnt; i++)
+    {
+      struct cache_entry *e = &entries[i];
+      if (e->dirty && e->dirty_tick <= deadline && !e->meta &&
+          !e->committing)
+        {
+          e->pin_cnt++;
+          flush_batch[batch_cnt++] = e;
+        }
+    }
+  lock_release (&cache_lock);
+
+  qsort (flush_batch, batch_cnt, sizeof *flush_batch, compare_sectors);
+
+  for (i = 0; i < batch_cnt; i++)
+    {
+      struct cache_entry *e = flush_batch[i];
+
+      /* E may have gained changes for the journal since it was
+         picked.  Only a commit sets COMMITTING, and only on entries
+         with META set, which cannot become set while we hold the
+         data lock.  Holding several data locks at once is safe
+         because no other thread ever holds more than one. */
+      lock_acquire (&e->data_lock);
+      if (!e->dirty || e->meta || e->committing)
+        {
+          lock_acquire (&cache_lock);
+          cache_unpin (e);
+          lock_release (&cache_lock);
+          continue;
+        }
+
+      if (run_cnt > 0 && (run_cnt == BLOCK_VEC_MAX ||
+                          flush_run[run_cnt - 1]->sector + 1 != e->sector))
+        {
+          write_run (run_cnt);
+          run_cnt = 0;
+        }
+      flush_run[run_cnt++] = e;
+    }
+  write_run (run_cnt);
+
+  lock_release (&flush_lock);
+  return batch_cnt;
+}
+
+/* Writes every dirty sector in the cache back to disk, except
+   those waiting for the journal. */
+void cache_flush (void) { cache_write_back (INT64_MAX); }
+
+/* Flusher thread.  Periodically writes back sectors that have
+   been dirty for a while, so that writers rarely have to wait for
+   a dirty victim to be written during eviction, and writes back
+   everything early when too much of the cache is dirty. */
+static void flusher_thread (void *aux UNUSED)
+{
+  for (;;)
+    {
+      int64_t now;
+      bool pressure;
+
+      timer_sleep (FLUSH_TICKS);
+
+      journal_commit ();
+      now = timer_ticks ();
+      lock_acquire (&cache_lock);
+      pressure = dirty_cnt > FLUSH_HIGH_WATER (entry_cnt);
+      lock_release (&cache_lock);
+
+      cache_write_back (pressure ? INT64_MAX : now - FLUSH_MAX_AGE);
+    }
+}
+
+/* Returns true if so many entries hold uncommitted metadata that
+   the journal should be committed before more is changed. */
+bool cache_meta_full (void)
+{
+  bool full;
+
+  lock_acquire (&cache_lock);
+  full = meta_cnt >= META_HIGH_WATER (entry_cnt);
+  lock_release (&cache_lock);
+  return full;
+}
+
+/* Returns the number of entries with uncommitted metadata, which
+   is what cache_begin_commit() would return now. */
+size_t cache_meta_count (void)
+{
+  size_t cnt;
+
+  lock_acquire (&cache_lock);
+  cnt = meta_cnt;
+  lock_release (&cache_lock);
+  return cnt;
+}
+
+/* Returns true if SECTOR is cached with changes that are not yet
+   committed to the journal, or are being committed. */
+bool cache_uncommitted (block_sector_t sector)
+{
+  struct cache_entry *e;
+  bool uncommitted;
+
+  lock_acquire (&cache_lock);
+  e = cache_lookup (sector);
+  uncommitted = e != NULL && (e->meta || e->committing);
+  lock_release (&cache_lock);
+  return uncommitted;
+}
+
+/* Starts committing every entry with uncommitted metadata, which
+   must not change until cache_end_commit().  Returns the number of
+   such entries, which cache_commit_entry() then returns one by
+   one. */
+size_t cache_begin_commit (void)
+{
+  size_t i;
+
+  ASSERT (commit_cnt == 0);
+
+  lock_acquire (&cache_lock);
+  for (i = 0; i < entry_cnt; i++)
+    {
+      struct cache_entry *e = &entries[i];
+      if (e->meta)
+        {
+          e->meta = false;
+          e->committing = true;
+          e->pin_cnt++;
+          commit_batch[commit_cnt++] = e;
+        }
+    }
+  meta_cnt = 0;
+  lock_release (&cache_lock);
+  return commit_cnt;
+}
+
+/* Returns the data of entry IDX of the commit in progress and
+   stores its sector number into *SECTOR. */
+const void *cache_commit_entry (size_t idx, block_sector_t *sector)
+{
+  ASSERT (idx < commit_cnt);
+
+  *sector = commit_batch[idx]->sector;
+  return commit_batch[idx]->data;
+}
+
+/* Finishes the commit started by cache_begin_commit(), after which
+   the committed entries may be written back. */
+void cache_end_commit (void)
+{
+  size_t i;
+
+  lock_acquire (&cache_lock);
+  for (i = 0; i < commit_cnt; i++)
+    {
+      struct cache_entry *e = commit_batch[i];
+      e->committing = false;
+      e->pin_cnt--;
+    }
+  commit_cnt = 0;
+  cond_broadcast (&cache_unpinned, &cache_lock);
+  lock_release (&cache_lock);
+}
+
+/* Prints buffer cache statistics. */
+void cache_print_stats (void)
+{
+  printf ("Buffer cache: %zu sectors, %llu hits, %llu misses, "
+          "%llu read-aheads, %llu write-backs\n",
+          entry_cnt, hit_cnt, miss_cnt, prefetch_cnt, writeback_cnt);
+}
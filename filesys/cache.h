@@ -0,0 +1,36 @@
+#ifndef FILESYS_CACHE_H
+#define FILESYS_CACHE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "devices/block.h"
+#include "filesys/off_t.h"
+
+/* Number of sectors held by the buffer cache unless overridden
+   with the -cache kernel command line option. */
+#define CACHE_DEFAULT_SECTORS 64
+
+void cache_configure (size_t sectors);
+void cache_init (void);
+void cache_flush (void);
+
+void cache_read (block_sector_t, void *);
+void cache_read_at (block_sector_t, void *, off_t ofs, off_t size);
+void cache_write (block_sector_t, const void *, bool meta);
+void cache_write_at (block_sector_t, const void *, off_t ofs, off_t size,
+                     bool meta);
+void cache_write_new (block_sector_t, const void *, off_t ofs, off_t size,
+                      bool meta);
+void cache_fill (block_sector_t, int byte, bool meta);
+void cache_readahead (block_sector_t);
+
+bool cache_meta_full (void);
+size_t cache_meta_count (void);
+bool cache_uncommitted (block_sector_t);
+size_t cache_begin_commit (void);
+const void *cache_commit_entry (size_t, block_sector_t *);
+void cache_end_commit (void);
+
+void cache_print_stats (void);
+
+#endif /* filesys/cache.h */
@@ -0,0 +1,150 @@
+#include "filesys/dcache.h"
+#include <debug.h>
+#include <hash.h>
+#include <list.h>
+#include <string.h>
+#include "filesys/directory.h"
+#include "filesys/inode.h"
+#include "threads/synch.h"
+
+/* Number of directory entries remembered, and number of hash
+   buckets they are spread over. */
+#define DCACHE_ENTRIES 512
+#define DCACHE_BUCKETS 256
+
+/* A remembered result of looking up NAME in directory PARENT. */
+struct dentry
+{
+  struct list_elem hash_elem; /* Element in a bucket. */
+  struct list_elem lru_elem;  /* Element in lru_list. */
+  block_sector_t parent;      /* Directory's inode sector, or
+                                 UNALLOCATED_SECTOR if unused. */
+  block_sector_t sector;      /* NAME's inode sector, or
+                                 UNALLOCATED_SECTOR if NAME does
+                                 not exist. */
+  char name[NAME_MAX + 1];    /* Null terminated file name. */
+};
+
+static struct dentry dentries[DCACHE_ENTRIES];
+static struct list buckets[DCACHE_BUCKETS];
+
+/* All entries, most recently used first.  Unused entries are at
+   the back. */
+static struct list lru_list;
+
+/* Protects all of the above. */
+static struct lock dcache_lock;
+
+/* Initializes the directory entry cache. */
+void dcache_init (void)
+{
+  size_t i;
+
+  for (i = 0; i < DCACHE_BUCKETS; i++)
+    list_init (&buckets[i]);
+  list_init (&lru_list);
+  for (i = 0; i < DCACHE_ENTRIES; i++)
+    {
+      dentries[i].parent = UNALLOCATED_SECTOR;
+      list_push_back (&lru_list, &dentries[i].lru_elem);
+    }
+  lock_init (&dcache_lock);
+}
+
+/* Returns the bucket for NAME in directory PARENT. */
+static struct list *bucket_for (block_sector_t parent, const char *name)
+{
+  return &buckets[(hash_string (name) ^ hash_int (parent)) % DCACHE_BUCKETS];
+}
+
+/* Returns the entry for NAME in directory PARENT, or a null
+   pointer if there is none.  The dcache lock must be held. */
+static struct dentry *find (block_sector_t parent, const char *name)
+{
+  struct list *bucket = bucket_for (parent, name);
+  struct list_elem *e;
+
+  for (e = list_begin (bucket); e != list_end (bucket); e = list_next (e))
+    {
+      struct dentry *d = list_entry (e, struct dentry, hash_elem);
+      if (d->parent == parent && !strcmp (d->name, name))
+        return d;
+    }
+  return NULL;
+}
+
+/* Makes D unused and moves it to the back of lru_list.  The
+   dcache lock must be held. */
+static void discard (struct dentry *d)
+{
+  list_remove (&d->hash_elem);
+  d->parent = UNALLOCATED_SECTOR;
+  list_remove (&d->lru_elem);
+  list_push_back (&lru_list, &d->lru_elem);
+}
+
+/* Looks up NAME in directory PARENT.  If the result is cached,
+   stores the sector of NAME's inode in *SECTORP, or
+   UNALLOCATED_SECTOR if NAME is known not to exist, and returns
+   true.  Returns false if nothing is known about NAME. */
+bool dcache_lookup (block_sector_t parent, const char *name,
+                    block_sector_t *sectorp)
+{
+  struct dentry *d;
+
+  if (strlen (name) > NAME_MAX)
+    return false;
+
+  lock_acquire (&dcache_lock);
+  d = find (parent, name);
+  if (d != NULL)
+    {
+      *sectorp = d->sector;
+      list_remove (&d->lru_elem);
+      list_push_front (&lru_list, &d->lru_elem);
+    }
+  lock_release (&dcache_lock);
+  return d != NULL;
+}
+
+/* Records that NAME in directory PARENT refers to the inode in
+   SECTOR, or that NAME does not exist if SECTOR is
+   UNALLOCATED_SECTOR.  Replaces the least recently used entry if
+   the cache is full. */
+void dcache_insert (block_sector_t parent, const char *name,
+                    block_sector_t sector)
+{
+  struct dentry *d;
+
+  if (strlen (name) > NAME_MAX)
+    return;
+
+  lock_acquire (&dcache_lock);
+  d = find (parent, name);
+  if (d == NULL)
+    {
+      d = list_entry (list_back (&lru_list), struct dentry, lru_elem);
+      if (d->parent != UNALLOCATED_SECTOR)
+        list_remove (&d->hash_elem);
+      d->parent = parent;
+      strlcpy (d->name, name, sizeof d->name);
+      list_push_front (bucket_for (parent, name), &d->hash_elem);
+    }
+  d->sector = sector;
+  list_remove (&d->lru_elem);
+  list_push_front (&lru_list, &d->lru_elem);
+  lock_release (&dcache_lock);
+}
+
+/* Forgets every entry in directory PARENT.  Must be called when
+   PARENT is removed, before its sector can be reused. */
+void dcache_purge (block_sector_t parent)
+{
+  size_t i;
+
+  lock_acquire (&dcache_lock);
+  for (i = 0; i < DCACHE_ENTRIES; i++)
+    if (dentries[i].parent == parent)
+      discard (&dentries[i]);
+  lock_release (&dcache_lock);
+}
@@ -1,18 +1,376 @@
 #include "filesys/directory.h"
+#include <stddef.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <string.h>
+#include <hash.h>
 #include <list.h>
+#include <round.h>
+#include "filesys/dcache.h"
 #include "filesys/filesys.h"
 #include "filesys/inode.h"
 #include "threads/malloc.h"
 #include "filesys/free-map.h"
 #include "userprog/syscall.h"
 
-/* Creates a directory with space for ENTRY_CNT entries in the
-   given SECTOR.  Returns true if successful, false on failure. */
-bool dir_create (block_sector_t sector, size_t entry_cnt)
+/* Hashed directories.
+
+   A directory is a hash table of sector-sized buckets, indexed by
+   extendible hashing.  Block 0 of the directory's file is a
+   header that maps the low DEPTH bits of a name's hash to the
+   block of the bucket that holds the name.  A full bucket is split
+   in two, doubling the header's table first if necessary, so that
+   a lookup reads the header and one bucket however many entries
+   the directory holds.  Once the table has DIR_HASH_SLOTS slots,
+   full buckets are extended with chains of overflow buckets
+   instead.
+
+   A new directory starts out as a plain array of entries, searched
+   linearly, that fits inside its inode.  It is converted to the
+   hashed format when it outgrows the inode.  Directories created
+   by older kernels may be plain arrays of any size; they are
+   never converted. */
+
+/* Identifies a hashed directory.  Too large to be the sector
+   number at the start of a linear directory. */
+#define DIR_HASH_MAGIC 0x48444952
+
+/* Largest DEPTH a header can hold. */
+#define DIR_HASH_MAX_DEPTH 7
+#define DIR_HASH_SLOTS (1 << DIR_HASH_MAX_DEPTH)
+
+/* Hashed directory header, in block 0. */
+struct dir_header
+{
+  uint32_t magic;                   /* DIR_HASH_MAGIC. */
+  uint32_t depth;                   /* Number of hash bits in use. */
+  uint16_t buckets[DIR_HASH_SLOTS]; /* Bucket block for each slot. */
+  uint8_t unused[BLOCK_SECTOR_SIZE - 2 * sizeof (uint32_t) -
+                 DIR_HASH_SLOTS * sizeof (uint16_t)];
+};
+
+/* Hashed directory bucket, one per block after the header. */
+#define DIR_BUCKET_ENTRIES                                                     \
+  ((BLOCK_SECTOR_SIZE - 2 * sizeof (uint16_t)) / sizeof (struct dir_entry))
+struct dir_bucket
+{
+  struct dir_entry entries[DIR_BUCKET_ENTRIES];
+  uint16_t depth; /* Number of low hash bits shared by all entries. */
+  uint16_t next;  /* Block of next overflow bucket, or 0. */
+  uint8_t unused[BLOCK_SECTOR_SIZE - 2 * sizeof (uint16_t) -
+                 DIR_BUCKET_ENTRIES * sizeof (struct dir_entry)];
+};
+
+/* Returns the byte offset of entry IDX of bucket BLOCK. */
+static off_t entry_ofs (uint16_t block, size_t idx)
+{
+  return block * BLOCK_SECTOR_SIZE + idx * sizeof (struct dir_entry);
+}
+
+/* Returns the byte offset of member MEMBER of bucket BLOCK. */
+#define BUCKET_OFS(BLOCK, MEMBER)                                              \
+  ((BLOCK) * BLOCK_SECTOR_SIZE + offsetof (struct dir_bucket, MEMBER))
+
+/* Returns true if INODE holds a hashed directory. */
+static bool is_hashed (struct inode *inode)
+{
+  uint32_t magic;
+  return inode_read_at (inode, &magic, sizeof magic, 0) == sizeof magic &&
+         magic == DIR_HASH_MAGIC;
+}
+
+/* Returns true if DIR is hashed.  DIR->hashed is only a hint,
+   since another opener may have converted the directory since DIR
+   was opened. */
+static bool dir_is_hashed (const struct dir *dir)
+{
+  return dir->hashed || is_hashed (dir->inode);
+}
+
+/* Reads hashed directory DIR's header depth into *DEPTH and its
+   bucket table into SLOTS.  Returns true if successful. */
+static bool read_table (const struct dir *dir, uint32_t *depth,
+                        uint16_t slots[DIR_HASH_SLOTS])
+{
+  return inode_read_at (dir->inode, depth, sizeof *depth,
+                        offsetof (struct dir_header, depth)) ==
+             sizeof *depth &&
+         inode_read_at (dir->inode, slots, DIR_HASH_SLOTS * sizeof *slots,
+                        offsetof (struct dir_header, buckets)) ==
+             DIR_HASH_SLOTS * sizeof *slots;
+}
+
+/* Returns the first bucket block for a name with hash value HASH
+   in hashed directory DIR, or 0 on failure.  Stores the header's
+   depth in *DEPTH. */
+static uint16_t first_bucket (const struct dir *dir, unsigned hash,
+                              uint32_t *depth)
+{
+  uint16_t block;
+  off_t ofs;
+
+  if (inode_read_at (dir->inode, depth, sizeof *depth,
+                     offsetof (struct dir_header, depth)) != sizeof *depth)
+    return 0;
+  ofs = offsetof (struct dir_header, buckets) +
+        (hash & ((1u << *depth) - 1)) * sizeof block;
+  if (inode_read_at (dir->inode, &block, sizeof block, ofs) != sizeof block)
+    return 0;
+  return block;
+}
+
+/* Returns the overflow bucket that follows bucket BLOCK in DIR,
+   or 0 if there is none. */
+static uint16_t next_bucket (const struct dir *dir, uint16_t block)
+{
+  uint16_t next;
+  if (inode_read_at (dir->inode, &next, sizeof next,
+                     BUCKET_OFS (block, next)) != sizeof next)
+    return 0;
+  return next;
+}
+
+/* Returns the block number that a bucket appended to DIR would
+   have, or 0 if DIR cannot grow further. */
+static uint16_t new_bucket (const struct dir *dir)
+{
+  off_t block = inode_length (dir->inode) / BLOCK_SECTOR_SIZE;
+  return block <= UINT16_MAX ? block : 0;
+}
+
+/* Splits bucket BLOCK of hashed directory DIR, whose local depth
+   DEPTH is less than the header's, moving the entries whose hash
+   has bit DEPTH set to a new bucket.  Returns true if
+   successful. */
+static bool split_bucket (struct dir *dir, uint16_t block, uint32_t depth)
+{
+  struct dir_bucket *old = malloc (sizeof *old);
+  struct dir_bucket *new = calloc (1, sizeof *new);
+  uint16_t slots[DIR_HASH_SLOTS];
+  uint32_t table_depth;
+  uint16_t new_block = new_bucket (dir);
+  bool success = false;
+
+  if (old == NULL || new == NULL || new_block == 0 ||
+      inode_read_at (dir->inode, old, sizeof *old,
+                     BUCKET_OFS (block, entries)) != sizeof *old ||
+      !read_table (dir, &table_depth, slots))
+    goto done;
+
+  for (size_t i = 0; i < DIR_BUCKET_ENTRIES; i++)
+    if (old->entries[i].in_use &&
+        (hash_string (old->entries[i].name) >> depth) & 1)
+      {
+        new->entries[i] = old->entries[i];
+        old->entries[i].in_use = false;
+      }
+  old->depth = new->depth = depth + 1;
+  new->next = 0;
+
+  /* Write the new bucket before pointing the table at it. */
+  if (inode_write_at (dir->inode, new, sizeof *new,
+                      BUCKET_OFS (new_block, entries)) != sizeof *new ||
+      inode_write_at (dir->inode, old, sizeof *old,
+                      BUCKET_OFS (block, entries)) != sizeof *old)
+    goto done;
+  for (size_t i = 0; i < (1u << table_depth); i++)
+    if (slots[i] == block && (i >> depth) & 1)
+      slots[i] = new_block;
+  success = inode_write_at (dir->inode, slots, sizeof slots,
+                            offsetof (struct dir_header, buckets)) ==
+            sizeof slots;
+
+done:
+  free (old);
+  free (new);
+  return success;
+}
+
+/* Doubles the bucket table of hashed directory DIR, whose depth
+   is DEPTH.  Returns true if successful. */
+static bool grow_table (struct dir *dir, uint32_t depth)
+{
+  uint16_t slots[DIR_HASH_SLOTS];
+  size_t half = 1u << depth;
+
+  ASSERT (depth < DIR_HASH_MAX_DEPTH);
+  if (!read_table (dir, &depth, slots))
+    return false;
+  memcpy (slots + half, slots, half * sizeof *slots);
+  depth++;
+  return inode_write_at (dir->inode, slots, sizeof slots,
+                         offsetof (struct dir_header, buckets)) ==
+             sizeof slots &&
+         inode_write_at (dir->inode, &depth, sizeof depth,
+                         offsetof (struct dir_header, depth)) == sizeof depth;
+}
+
+/* Appends an overflow bucket holding entry E to the chain that
+   ends with bucket LAST in hashed directory DIR.  Returns true if
+   successful. */
+static bool add_overflow (struct dir *dir, uint16_t last,
+                          const struct dir_entry *e)
+{
+  struct dir_bucket *bucket = calloc (1, sizeof *bucket);
+  uint16_t block = new_bucket (dir);
+  bool success = false;
+
+  if (bucket != NULL && block != 0)
+    {
+      bucket->entries[0] = *e;
+      bucket->depth = DIR_HASH_MAX_DEPTH;
+      bucket->next = 0;
+      success = inode_write_at (dir->inode, bucket, sizeof *bucket,
+                                BUCKET_OFS (block, entries)) ==
+                    sizeof *bucket &&
+                inode_write_at (dir->inode, &block, sizeof block,
+                                BUCKET_OFS (last, next)) == sizeof block;
+    }
+  free (bucket);
+  return success;
+}
+
+/* Searches hashed directory DIR like lookup() below. */
+static bool hashed_lookup (const struct dir *dir, const char *name,
+                           struct dir_entry *ep, off_t *ofsp)
+{
+  struct dir_entry e;
+  uint32_t depth;
+  uint16_t block;
+
+  for (block = first_bucket (dir, hash_string (name), &depth); block != 0;
+       block = next_bucket (dir, block))
+    for (size_t i = 0; i < DIR_BUCKET_ENTRIES; i++)
+      {
+        off_t ofs = entry_ofs (block, i);
+        if (inode_read_at (dir->inode, &e, sizeof e, ofs) != sizeof e)
+          return false;
+        if (e.in_use && !strcmp (name, e.name))
+          {
+            if (ep != NULL)
+              *ep = e;
+            if (ofsp != NULL)
+              *ofsp = ofs;
+            return true;
+          }
+      }
+  return false;
+}
+
+/* Stores entry NEW, whose name is not yet in hashed directory DIR,
+   in the first free slot of its bucket, splitting the bucket if it
+   is full.  Returns true if successful. */
+static bool hashed_add (struct dir *dir, const struct dir_entry *new)
+{
+  unsigned hash = hash_string (new->name);
+
+  for (;;)
+    {
+      struct dir_entry e;
+      uint32_t depth;
+      uint16_t bucket_depth;
+      uint16_t first, block, last = 0;
+
+      first = first_bucket (dir, hash, &depth);
+      for (block = first; block != 0; block = next_bucket (dir, block))
+        {
+          for (size_t i = 0; i < DIR_BUCKET_ENTRIES; i++)
+            {
+              off_t ofs = entry_ofs (block, i);
+              if (inode_read_at (dir->inode, &e, sizeof e, ofs) != sizeof e)
+                return false;
+              if (!e.in_use)
+                return inode_write_at (dir->inode, new, sizeof *new, ofs) ==
+                       sizeof *new;
+            }
+          last = block;
+        }
+      if (last == 0 ||
+          inode_read_at (dir->inode, &bucket_depth, sizeof bucket_depth,
+                         BUCKET_OFS (first, depth)) != sizeof bucket_depth)
+        return false;
+
+      /* Every slot is taken: make room and try again. */
+      if (bucket_depth < depth)
+        {
+          if (!split_bucket (dir, first, bucket_depth))
+            return false;
+        }
+      else if (depth < DIR_HASH_MAX_DEPTH)
+        {
+          if (!grow_table (dir, depth))
+            return false;
+        }
+      else
+        return add_overflow (dir, last, new);
+    }
+}
+
+/* Returns the offset of the next entry that dir_readdir() should
+   read in hashed directory DIR, at or after POS. */
+static off_t hashed_next_pos (off_t pos)
+{
+  if (pos < BLOCK_SECTOR_SIZE)
+    return BLOCK_SECTOR_SIZE;
+  if ((size_t) (pos % BLOCK_SECTOR_SIZE) / sizeof (struct dir_entry) >=
+      DIR_BUCKET_ENTRIES)
+    return ROUND_UP (pos, BLOCK_SECTOR_SIZE);
+  return pos;
+}
+
+/* Writes a hashed directory into INODE whose only bucket holds the
+   CNT ENTRIES, in the same slots, replacing whatever its first two
+   blocks held.  Returns true if successful. */
+static bool init_hashed (struct inode *inode, const struct dir_entry *entries,
+                         size_t cnt)
 {
-  if (!inode_create (sector, entry_cnt * sizeof (struct dir_entry)))
+  struct dir_header *header = calloc (1, sizeof *header);
+  struct dir_bucket *bucket = calloc (1, sizeof *bucket);
+  bool success = false;
+
+  ASSERT (sizeof *header == BLOCK_SECTOR_SIZE);
+  ASSERT (sizeof *bucket == BLOCK_SECTOR_SIZE);
+  ASSERT (cnt <= DIR_BUCKET_ENTRIES);
+  if (header != NULL && bucket != NULL)
+    {
+      header->magic = DIR_HASH_MAGIC;
+      header->depth = 0;
+      header->buckets[0] = 1;
+      memcpy (bucket->entries, entries, cnt * sizeof *entries);
+      bucket->depth = 0;
+      bucket->next = 0;
+      success = inode_write_at (inode, bucket, sizeof *bucket,
+                                BLOCK_SECTOR_SIZE) == sizeof *bucket &&
+                inode_write_at (inode, header, sizeof *header, 0) ==
+                    sizeof *header;
+    }
+  free (header);
+  free (bucket);
+  return success;
+}
+
+/* Converts DIR, a linear directory stored in its inode that has
+   no room for another entry, to the hashed format.  Every entry
+   keeps its slot, now in the first bucket, so that a position saved
+   by a listing in progress still names the same entry afterward;
+   see dir_iterate().  Returns true if successful. */
+static bool make_hashed (struct dir *dir)
+{
+  struct dir_entry entries[INODE_INLINE_BYTES / sizeof (struct dir_entry)];
+  off_t size = inode_read_at (dir->inode, entries, sizeof entries, 0);
+
+  if (!init_hashed (dir->inode, entries, size / sizeof *entries))
+    return false;
+  dir->hashed = true;
+  return true;
+}
+
+/* Creates an empty directory in the given SECTOR.  ENTRY_CNT is
+   ignored, since a directory grows as entries are added.  Returns
+   true if successful, false on failure. */
+bool dir_create (block_sector_t sector, size_t entry_cnt UNUSED)
+{
+  if (!inode_create (sector, 0))
     return false;
   // Matthew driving
   struct inode *inode = inode_open (sector);
@@ -46,6 +404,7 @@ struct dir *dir_open (struct inode *inode)
     {
       dir->inode = inode;
       dir->pos = 0;
+      dir->hashed = is_hashed (inode);
       if (!inode->data.is_directory)
         {
           dir_close (dir);
@@ -106,6 +465,8 @@ static bool lookup (const struct dir *dir, const char *name,
   ASSERT (dir->inode != NULL);
   ASSERT (dir->inode->data.is_directory);
 
+  if (dir_is_hashed (dir))
+    return hashed_lookup (dir, name, ep, ofsp);
   for (ofs = 0; inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
        ofs += sizeof e)
     if (e.in_use && !strcmp (name, e.name))
@@ -126,12 +487,27 @@ static bool lookup (const struct dir *dir, const char *name,
 bool dir_lookup (const struct dir *dir, const char *name, struct inode **inode)
 {
   struct dir_entry e;
+  block_sector_t sector;
 
   ASSERT (dir != NULL);
   ASSERT (name != NULL);
 
-  if (lookup (dir, name, &e, NULL))
-    *inode = inode_open (e.inode_sector);
+  if (!dcache_lookup (dir->inode->sector, name, &sector))
+    {
+      /* Hold the directory lock so that a concurrent dir_add() or
+         dir_remove() cannot slip in between the search and
+         caching its result.  Lookups only need it for reading, so
+         they do not exclude one another. */
+      rwlock_acquire_read (&dir->inode->dir_lock);
+      sector = lookup (dir, name, &e, NULL) ? e.inode_sector
+                                            : UNALLOCATED_SECTOR;
+      if (!dir->inode->removed)
+        dcache_insert (dir->inode->sector, name, sector);
+      rwlock_release_read (&dir->inode->dir_lock);
+    }
+
+  if (sector != UNALLOCATED_SECTOR)
+    *inode = inode_open (sector);
   else
     *inode = NULL;
 
@@ -157,11 +533,20 @@ bool dir_add (struct dir *dir, const char *name, block_sector_t inode_sector)
   if (*name == '\0' || strlen (name) > NAME_MAX)
     return false;
 
-  lock_acquire (&dir->inode->dir_lock);
+  rwlock_acquire_write (&dir->inode->dir_lock);
   /* Check that NAME is not in use. */
   if (lookup (dir, name, NULL, NULL))
     goto done;
 
+  if (dir_is_hashed (dir))
+    {
+      e.in_use = true;
+      strlcpy (e.name, name, sizeof e.name);
+      e.inode_sector = inode_sector;
+      success = hashed_add (dir, &e);
+      goto record;
+    }
+
   /* Set OFS to offset of free slot.
      If there are no free slots, then it will be set to the
      current end-of-file.
@@ -179,10 +564,16 @@ bool dir_add (struct dir *dir, const char *name, block_sector_t inode_sector)
   strlcpy (e.name, name, sizeof e.name);
   e.inode_sector = inode_sector;
 
-  success = inode_write_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
+  if (inode_is_inline (dir->inode) && ofs + sizeof e > INODE_INLINE_BYTES)
+    success = make_hashed (dir) && hashed_add (dir, &e);
+  else
+    success = inode_write_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
+record:
+  if (success)
+    dcache_insert (dir->inode->sector, name, inode_sector);
   // Matthew driving
 done:
-  lock_release (&dir->inode->dir_lock);
+  rwlock_release_write (&dir->inode->dir_lock);
   return success;
 }
 
@@ -199,7 +590,7 @@ bool dir_remove (struct dir *dir, char *name)
   ASSERT (dir != NULL);
   ASSERT (name != NULL);
 
-  lock_acquire (&dir->inode->dir_lock);
+  rwlock_acquire_write (&dir->inode->dir_lock);
 
   /* Find directory entry. */
   if (!lookup (dir, name, &e, &ofs))
@@ -229,36 +620,103 @@ bool dir_remove (struct dir *dir, char *name)
   bool fail = inode_write_at (dir->inode, &e, sizeof e, ofs) != sizeof e;
   if (fail)
     goto done;
+  dcache_insert (dir->inode->sector, name, UNALLOCATED_SECTOR);
 
-  /* Remove inode. */
-  inode_remove (inode);
+  /* Remove inode.  A removed directory's cached entries must go
+     before its sector can be reused, and no lookup in it may cache
+     new ones afterward. */
+  if (inode->data.is_directory)
+    {
+      rwlock_acquire_write (&inode->dir_lock);
+      inode_remove (inode);
+      dcache_purge (inode->sector);
+      rwlock_release_write (&inode->dir_lock);
+    }
+  else
+    inode_remove (inode);
   success = true;
 done:
-  lock_release (&dir->inode->dir_lock);
+  rwlock_release_write (&dir->inode->dir_lock);
   inode_close (inode);
   return success;
 }
 
-/* Reads the next directory entry in DIR and stores the name in
-   NAME.  Returns true if successful, false if the directory
-   contains no more entries. */
-bool dir_readdir (struct dir *dir, char name[NAME_MAX + 1])
+/* Number of entries dir_iterate() reads at a time. */
+#define DIR_ITERATE_BATCH 8
+
+/* Calls FUNC on each entry of DIR from its current position on,
+   other than "." and "..", passing AUX along, until FUNC returns
+   false or the entries run out.  DIR's position ends up just past
+   the last entry FUNC accepted, so the entry it refused, if any, is
+   the first one seen next time.  The whole walk holds DIR's lock
+   once and reads several entries per call into the inode. */
+void dir_iterate (struct dir *dir, dir_iterate_func *func, void *aux)
 {
-  struct dir_entry e;
+  struct dir_entry entries[DIR_ITERATE_BATCH];
+
   ASSERT (dir != NULL);
-  lock_acquire (&dir->inode->dir_lock);
-  while (!dir->inode->removed &&
-         inode_read_at (dir->inode, &e, sizeof e, dir->pos) == sizeof e)
+  rwlock_acquire_read (&dir->inode->dir_lock);
+  dir->hashed = dir_is_hashed (dir);
+  while (!dir->inode->removed)
     {
-      dir->pos += sizeof e;
-      // Skip "." and ".." and unused entries
-      if (e.in_use && strcmp (e.name, ".") && strcmp (e.name, ".."))
+      off_t size = sizeof entries;
+      off_t cnt, i;
+
+      /* Hashed entries only run to the end of their bucket.  A
+         position inside the header block was saved before the
+         directory was converted, which moved each entry from the
+         linear array to the same slot of bucket 1. */
+      if (dir->hashed)
         {
-          lock_release (&dir->inode->dir_lock);
-          strlcpy (name, e.name, NAME_MAX + 1);
-          return true;
+          off_t end;
+          if (dir->pos > 0 && dir->pos < BLOCK_SECTOR_SIZE)
+            dir->pos += BLOCK_SECTOR_SIZE;
+          dir->pos = hashed_next_pos (dir->pos);
+          end = ROUND_DOWN (dir->pos, BLOCK_SECTOR_SIZE) +
+                DIR_BUCKET_ENTRIES * sizeof (struct dir_entry);
+          if (size > end - dir->pos)
+            size = end - dir->pos;
+        }
+      cnt = inode_read_at (dir->inode, entries, size, dir->pos) /
+            sizeof *entries;
+      if (cnt == 0)
+        break;
+
+      for (i = 0; i < cnt; i++)
+        {
+          struct dir_entry *e = &entries[i];
+          // Skip "." and ".." and unused entries
+          if (e->in_use && strcmp (e->name, ".") && strcmp (e->name, "..") &&
+              !func (e, aux))
+            goto done;
+          dir->pos += sizeof *e;
         }
     }
-  lock_release (&dir->inode->dir_lock);
-  return false;
+done:
+  rwlock_release_read (&dir->inode->dir_lock);
+}
+
+/* dir_iterate() function for dir_readdir().  Copies the name of
+   the first entry into the buffer AUX points to, and refuses the
+   next. */
+static bool readdir_one (const struct dir_entry *e, void *aux)
+{
+  char **name = aux;
+
+  if (*name == NULL)
+    return false;
+  strlcpy (*name, e->name, NAME_MAX + 1);
+  *name = NULL;
+  return true;
+}
+
+/* Reads the next directory entry in DIR and stores the name in
+   NAME.  Returns true if successful, false if the directory
+   contains no more entries. */
+bool dir_readdir (struct dir *dir, char name[NAME_MAX + 1])
+{
+  char *p = name;
+
+  dir_iterate (dir, readdir_one, &p);
+  return p == NULL;
 }
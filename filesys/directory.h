@@ -19,6 +19,7 @@ struct dir
 {
   struct inode *inode; /* Backing store. */
   off_t pos;           /* Current position. */
+  bool hashed;         /* Hashed format?  Otherwise a linear array. */
 };
 
 /* A single directory entry. */
@@ -43,4 +44,9 @@ bool dir_add (struct dir *, const char *name, block_sector_t);
 bool dir_remove (struct dir *, char *name);
 bool dir_readdir (struct dir *, char name[NAME_MAX + 1]);
 
+/* Called by dir_iterate() on each entry, with the AUX passed to
+   it.  Returns false to stop before the entry. */
+typedef bool dir_iterate_func (const struct dir_entry *, void *aux);
+void dir_iterate (struct dir *, dir_iterate_func *, void *aux);
+
 #endif /* filesys/directory.h */
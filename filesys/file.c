@@ -1,8 +1,17 @@
 #include "filesys/file.h"
 #include <debug.h>
+#include <round.h>
 #include "filesys/inode.h"
 #include "threads/malloc.h"
 
+/* Bounds on the read-ahead window, in sectors.  The window starts
+   at the minimum and doubles on every sequential read. */
+#define READAHEAD_MIN 2
+#define READAHEAD_MAX 32
+
+/* Bytes moved at a time by file_copy(). */
+#define COPY_CHUNK (8 * BLOCK_SECTOR_SIZE)
+
 /* Opens a file for the given INODE, of which it takes ownership,
    and returns the new file.  Returns a null pointer if an
    allocation fails or if INODE is null. */
@@ -15,6 +24,9 @@ struct file *file_open (struct inode *inode)
       file->pos = 0;
       file->dir_pos = 0;
       file->deny_write = false;
+      file->ra_next = 0;
+      file->ra_end = 0;
+      file->ra_window = 0;
       return file;
     }
   else
@@ -46,6 +58,46 @@ void file_close (struct file *file)
 /* Returns the inode encapsulated by FILE. */
 struct inode *file_get_inode (struct file *file) { return file->inode; }
 
+/* Updates FILE's sequential access detector after a read of
+   BYTES_READ bytes at offset OFS, and if the reads look
+   sequential, asks for the sectors following them to be read
+   ahead in the background. */
+static void file_readahead (struct file *file, off_t ofs, off_t bytes_read)
+{
+  off_t end = ofs + bytes_read;
+  off_t start, want;
+
+  if (bytes_read == 0)
+    return;
+
+  if (ofs != file->ra_next)
+    {
+      /* Not sequential: stop reading ahead until it is again. */
+      file->ra_next = end;
+      file->ra_end = 0;
+      file->ra_window = 0;
+      return;
+    }
+  file->ra_next = end;
+  if (file->ra_window == 0)
+    file->ra_window = READAHEAD_MIN;
+  else if (file->ra_window < READAHEAD_MAX)
+    file->ra_window *= 2;
+
+  /* Top up the window only once half of it has been consumed, so
+     that requests go out in batches. */
+  start = ROUND_UP (end, BLOCK_SECTOR_SIZE);
+  if (file->ra_end > start)
+    start = file->ra_end;
+  want = ROUND_UP (end, BLOCK_SECTOR_SIZE) +
+         file->ra_window * BLOCK_SECTOR_SIZE;
+  if (want - start < file->ra_window * BLOCK_SECTOR_SIZE / 2)
+    return;
+
+  inode_readahead (file->inode, start, want - start);
+  file->ra_end = want;
+}
+
 /* Reads SIZE bytes from FILE into BUFFER,
    starting at the file's current position.
    Returns the number of bytes actually read,
@@ -54,6 +106,7 @@ struct inode *file_get_inode (struct file *file) { return file->inode; }
 off_t file_read (struct file *file, void *buffer, off_t size)
 {
   off_t bytes_read = inode_read_at (file->inode, buffer, size, file->pos);
+  file_readahead (file, file->pos, bytes_read);
   file->pos += bytes_read;
   return bytes_read;
 }
@@ -95,6 +148,46 @@ off_t file_write_at (struct file *file, const void *buffer, off_t size,
   return inode_write_at (file->inode, buffer, size, file_ofs);
 }
 
+/* Copies up to SIZE bytes from SRC to DST, starting at each
+   file's current position and advancing both by the number of
+   bytes copied, which is returned.  The data moves from the
+   buffer cache to the buffer cache through a kernel buffer, in
+   chunks that start on SRC's sector boundaries after the first.
+   Fewer than SIZE bytes are copied at the end of SRC, if DST
+   cannot grow, or if memory is short. */
+off_t file_copy (struct file *dst, struct file *src, off_t size)
+{
+  uint8_t *buffer = malloc (COPY_CHUNK);
+  off_t copied = 0;
+
+  if (buffer == NULL)
+    return 0;
+  while (size > 0)
+    {
+      off_t chunk = COPY_CHUNK - src->pos % BLOCK_SECTOR_SIZE;
+      off_t bytes_read, bytes_written;
+
+      if (chunk > size)
+        chunk = size;
+      bytes_read = file_read (src, buffer, chunk);
+      if (bytes_read == 0)
+        break;
+      bytes_written = file_write (dst, buffer, bytes_read);
+      copied += bytes_written;
+      size -= bytes_written;
+      if (bytes_written < bytes_read)
+        {
+          /* Leave SRC just past the bytes that made it. */
+          src->pos -= bytes_read - bytes_written;
+          break;
+        }
+      if (bytes_read < chunk)
+        break;
+    }
+  free (buffer);
+  return copied;
+}
+
 /* Prevents write operations on FILE's underlying inode
    until file_allow_write() is called or FILE is closed. */
 void file_deny_write (struct file *file)
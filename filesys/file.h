@@ -12,6 +12,9 @@ struct file
   off_t pos;           /* Current position. */
   off_t dir_pos;       /* Position in directory used for readdir */
   bool deny_write;     /* Has file_deny_write() been called? */
+  off_t ra_next;       /* Offset at which a sequential read would start. */
+  off_t ra_end;        /* End of the range already queued for read-ahead. */
+  int ra_window;       /* Read-ahead window in sectors, 0 if not sequential. */
 };
 
 /* Opening and closing files. */
@@ -25,6 +28,7 @@ off_t file_read (struct file *, void *, off_t);
 off_t file_read_at (struct file *, void *, off_t size, off_t start);
 off_t file_write (struct file *, const void *, off_t);
 off_t file_write_at (struct file *, const void *, off_t size, off_t start);
+off_t file_copy (struct file *dst, struct file *src, off_t size);
 
 /* Preventing writes. */
 void file_deny_write (struct file *);
@@ -3,10 +3,13 @@
 #include <debug.h>
 #include <stdio.h>
 #include <string.h>
+#include "filesys/cache.h"
+#include "filesys/dcache.h"
 #include "filesys/file.h"
 #include "filesys/free-map.h"
 #include "filesys/inode.h"
 #include "filesys/directory.h"
+#include "filesys/journal.h"
 
 /* Constant for "." string */
 const char *dot_string = ".";
@@ -14,6 +17,9 @@ const char *dot_string = ".";
 /* Partition that contains the file system. */
 struct block *fs_device;
 
+/* If true, do_format() uses extent-based inodes. */
+bool filesys_extents;
+
 static void do_format (void);
 
 /* Initializes the file system module.
@@ -24,22 +30,37 @@ void filesys_init (bool format)
   if (fs_device == NULL)
     PANIC ("No file system device found, can't initialize file system.");
 
+  cache_init ();
+  dcache_init ();
   inode_init ();
   free_map_init ();
 
   if (format)
     do_format ();
+  else
+    journal_open ();
 
   free_map_open ();
   // Indicate that root is a directory
   struct inode *root = inode_open (ROOT_DIR_SECTOR);
+  if (root == NULL)
+    PANIC ("can't open root directory; reformat with -f");
   root->data.is_directory = true;
+  /* New inodes use the same layout as the rest of the file
+     system. */
+  inode_set_extents (inode_has_extents (root));
   thread_current ()->curr_directory = dir_open (root);
 }
 
 /* Shuts down the file system module, writing any unwritten data
    to disk. */
-void filesys_done (void) { free_map_close (); }
+void filesys_done (void)
+{
+  inode_done ();
+  free_map_close ();
+  journal_done ();
+  cache_flush ();
+}
 
 // Matthew driving
 /* Parse the given path, returning the directory that it lives in and setting
@@ -106,7 +127,8 @@ bool filesys_create (const char *name, off_t initial_size, bool is_dir)
   block_sector_t inode_sector = 0;
   char *filename = NULL;
   struct dir *dir = get_dir (name, &filename);
-  bool success = (dir != NULL && free_map_allocate (1, &inode_sector) &&
+  bool success = (dir != NULL &&
+                  free_map_allocate (1, dir->inode->sector, &inode_sector) &&
                   (is_dir ? dir_create (inode_sector, initial_size) :
                             inode_create (inode_sector, initial_size)));
   if (success)
@@ -170,7 +192,9 @@ bool filesys_remove (const char *name)
 static void do_format (void)
 {
   printf ("Formatting file system...");
+  inode_set_extents (filesys_extents);
   free_map_create ();
+  journal_create ();
   if (!dir_create (ROOT_DIR_SECTOR, 16))
     PANIC ("root directory creation failed");
   free_map_close ();
@@ -7,10 +7,15 @@
 /* Sectors of system file inodes. */
 #define FREE_MAP_SECTOR 0 /* Free map file inode sector. */
 #define ROOT_DIR_SECTOR 1 /* Root directory file inode sector. */
+#define JOURNAL_SECTOR 2  /* First sector of the metadata journal. */
 
 /* Block device that contains the file system. */
 extern struct block *fs_device;
 
+/* If true, formatting creates a file system with extent-based
+   inodes.  Controlled by kernel command-line option "-extents". */
+extern bool filesys_extents;
+
 void filesys_init (bool format);
 void filesys_done (void);
 bool filesys_create (const char *name, off_t initial_size, bool is_dir);
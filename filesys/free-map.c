@@ -1,26 +1,61 @@
 #include "filesys/free-map.h"
 #include <bitmap.h>
 #include <debug.h>
+#include <round.h>
 #include "filesys/file.h"
 #include "filesys/filesys.h"
 #include "filesys/inode.h"
+#include "filesys/journal.h"
+#include "threads/malloc.h"
 #include "threads/synch.h"
 
 typedef unsigned long elem_type;
 
 static struct file *free_map_file; /* Free map file. */
 static struct bitmap *free_map;    /* Free map, one bit per sector. */
-size_t start_heuristic = 0;
 struct lock free_map_lock;
 
+/* Sectors of the free map file that differ from FREE_MAP, one bit
+   per sector.  Changes to the free map are written back only at
+   flush points, and then only for these sectors. */
+static struct bitmap *dirty_map;
+
+/* Number of free map bits stored in one sector of its file. */
+#define BITS_PER_SECTOR (BLOCK_SECTOR_SIZE * 8)
+
+/* The disk is divided into block groups, each of whose free map
+   bits fill one sector of the free map file.  Allocations search
+   the group of a nearby sector first, so that a file's inode lands
+   near its directory and its data near its inode. */
+#define GROUP_SECTORS BITS_PER_SECTOR
+
+/* A block group. */
+struct block_group
+{
+  size_t free_cnt; /* Number of free sectors in the group. */
+  size_t hint;     /* No sector in the group before this is free. */
+};
+
+static struct block_group *groups; /* All block groups. */
+static size_t group_cnt;           /* Number of block groups. */
+
+static void count_groups (void);
+
 /* Initializes the free map. */
 void free_map_init (void)
 {
   free_map = bitmap_create (block_size (fs_device));
-  if (free_map == NULL)
+  if (free_map != NULL)
+    dirty_map = bitmap_create (
+        DIV_ROUND_UP (bitmap_file_size (free_map), BLOCK_SECTOR_SIZE));
+  group_cnt = DIV_ROUND_UP (block_size (fs_device), GROUP_SECTORS);
+  groups = calloc (group_cnt, sizeof *groups);
+  if (free_map == NULL || dirty_map == NULL || groups == NULL)
     PANIC ("bitmap creation failed--file system device is too large");
   bitmap_mark (free_map, FREE_MAP_SECTOR);
   bitmap_mark (free_map, ROOT_DIR_SECTOR);
+  bitmap_set_multiple (free_map, JOURNAL_SECTOR, JOURNAL_SECTORS, true);
+  count_groups ();
   lock_init (&free_map_lock);
 }
 
@@ -36,47 +71,246 @@ struct bitmap
 };
 #endif
 
-/* Allocates CNT consecutive sectors from the free map and stores
-   the first into *SECTORP.
-   Returns true if successful, false if not enough consecutive
-   sectors were available or if the free_map file could not be
-   written. */
-bool free_map_allocate (size_t cnt, block_sector_t *sectorp)
+/* Marks the free map file sectors that hold the bits for sectors
+   START through START + CNT - 1 as needing write-back.  The free
+   map lock must be held. */
+static void mark_dirty (size_t start, size_t cnt)
 {
+  size_t first = start / BITS_PER_SECTOR;
+  size_t last = (start + cnt - 1) / BITS_PER_SECTOR;
+  bitmap_set_multiple (dirty_map, first, last - first + 1, true);
+}
+
+/* Recomputes every block group's free count from the free map
+   and resets its hint. */
+static void count_groups (void)
+{
+  size_t g;
 
-  block_sector_t sector;
-  if (start_heuristic + cnt > free_map->bit_cnt)
+  for (g = 0; g < group_cnt; g++)
     {
-      start_heuristic = 0;
+      size_t start = g * GROUP_SECTORS;
+      size_t cnt = bitmap_size (free_map) - start;
+      if (cnt > GROUP_SECTORS)
+        cnt = GROUP_SECTORS;
+      groups[g].free_cnt = cnt - bitmap_count (free_map, start, cnt, true);
+      groups[g].hint = start;
     }
-  lock_acquire (&free_map_lock);
-  sector = bitmap_scan_and_flip (free_map, start_heuristic, cnt, false);
-  if (sector == BITMAP_ERROR)
+}
+
+/* Updates the block groups holding sectors START through START +
+   CNT - 1, which have just been allocated if ALLOCATED is true and
+   released otherwise.  The free map lock must be held. */
+static void account_groups (size_t start, size_t cnt, bool allocated)
+{
+  while (cnt > 0)
     {
-      start_heuristic = 0;
-      sector = bitmap_scan_and_flip (free_map, start_heuristic, cnt, false);
+      struct block_group *bg = &groups[start / GROUP_SECTORS];
+      size_t n = GROUP_SECTORS - start % GROUP_SECTORS;
+      if (n > cnt)
+        n = cnt;
+
+      if (allocated)
+        {
+          bg->free_cnt -= n;
+          if (bg->hint == start)
+            bg->hint = start + n;
+        }
+      else
+        {
+          bg->free_cnt += n;
+          if (bg->hint > start)
+            bg->hint = start;
+        }
+      start += n;
+      cnt -= n;
     }
-  if (sector != BITMAP_ERROR && free_map_file != NULL &&
-      !bitmap_write (free_map, free_map_file))
+}
+
+/* Returns the first sector of a run of CNT free sectors between
+   sectors START and END, exclusive, or BITMAP_ERROR if there is
+   none.  Unlike bitmap_scan(), which checks a whole run at each
+   candidate start, this tests each sector once.  The free map lock
+   must be held. */
+static size_t scan_range (size_t start, size_t end, size_t cnt)
+{
+  size_t run = 0;
+  size_t sector;
+
+  ASSERT (cnt > 0);
+  for (sector = start; sector < end; sector++)
+    if (bitmap_test (free_map, sector))
+      run = 0;
+    else if (++run == cnt)
+      return sector + 1 - cnt;
+  return BITMAP_ERROR;
+}
+
+/* Returns the first sector of a run of CNT free sectors that lies
+   within a single block group, trying the group that holds sector
+   NEAR first and then the groups after it in turn.  Returns
+   BITMAP_ERROR if no group has such a run.  The free map lock must
+   be held. */
+static size_t group_scan (size_t cnt, block_sector_t near)
+{
+  size_t g = near < bitmap_size (free_map) ? near / GROUP_SECTORS : 0;
+  size_t i;
+
+  for (i = 0; i < group_cnt; i++, g = (g + 1) % group_cnt)
     {
-      bitmap_set_multiple (free_map, sector, cnt, false);
-      sector = BITMAP_ERROR;
+      struct block_group *bg = &groups[g];
+      size_t end = (g + 1) * GROUP_SECTORS;
+      size_t sector;
+
+      if (bg->free_cnt < cnt)
+        continue;
+      if (end > bitmap_size (free_map))
+        end = bitmap_size (free_map);
+      sector = scan_range (bg->hint, end, cnt);
+      if (sector != BITMAP_ERROR)
+        return sector;
+    }
+  return BITMAP_ERROR;
+}
+
+/* Marks the CNT sectors starting at SECTOR as allocated.  The free
+   map lock must be held. */
+static void take (size_t sector, size_t cnt)
+{
+  bitmap_set_multiple (free_map, sector, cnt, true);
+  mark_dirty (sector, cnt);
+  account_groups (sector, cnt, true);
+}
+
+/* Allocates CNT consecutive sectors as free_map_allocate() does,
+   but without reclaiming reserved sectors. */
+static bool allocate (size_t cnt, block_sector_t near,
+                      block_sector_t *sectorp)
+{
+  size_t sector;
+
+  lock_acquire (&free_map_lock);
+  sector = group_scan (cnt, near);
+  if (sector == BITMAP_ERROR)
+    {
+      /* Only a run that crosses into the next group will do. */
+      sector = scan_range (0, bitmap_size (free_map), cnt);
     }
-  lock_release (&free_map_lock);
   if (sector != BITMAP_ERROR)
     {
+      take (sector, cnt);
       *sectorp = sector;
-      start_heuristic = sector + 1;
     }
+  lock_release (&free_map_lock);
   return sector != BITMAP_ERROR;
 }
 
+/* Allocates a run of sectors as free_map_allocate_run() does,
+   but without reclaiming reserved sectors. */
+static size_t allocate_run (size_t max_cnt, block_sector_t hint,
+                            block_sector_t *sectorp)
+{
+  size_t sector, cnt;
+
+  ASSERT (max_cnt > 0);
+  lock_acquire (&free_map_lock);
+  if (hint < free_map->bit_cnt && !bitmap_test (free_map, hint))
+    sector = hint;
+  else
+    {
+      sector = group_scan (max_cnt, hint);
+      if (sector == BITMAP_ERROR)
+        sector = scan_range (0, bitmap_size (free_map), max_cnt);
+      if (sector == BITMAP_ERROR)
+        sector = group_scan (1, hint);
+      if (sector == BITMAP_ERROR)
+        {
+          lock_release (&free_map_lock);
+          return 0;
+        }
+    }
+
+  for (cnt = 1; cnt < max_cnt && sector + cnt < free_map->bit_cnt &&
+                !bitmap_test (free_map, sector + cnt);
+       cnt++)
+    continue;
+  take (sector, cnt);
+  lock_release (&free_map_lock);
+
+  *sectorp = sector;
+  return cnt;
+}
+
+/* Allocates CNT consecutive sectors from the free map, as close to
+   sector NEAR as possible, and stores the first into *SECTORP.
+   Returns true if successful, false if not enough consecutive
+   sectors were available even after reclaiming the sectors that
+   open files hold in reserve. */
+bool free_map_allocate (size_t cnt, block_sector_t near,
+                        block_sector_t *sectorp)
+{
+  return allocate (cnt, near, sectorp) ||
+         (inode_reclaim_prealloc () && allocate (cnt, near, sectorp));
+}
+
+/* Allocates a run of between 1 and MAX_CNT consecutive sectors
+   and stores the first into *SECTORP.  The run starts at sector
+   HINT if it is free; otherwise a run of MAX_CNT sectors is
+   preferred, searched for starting in HINT's block group, falling
+   back to the longest run available at the first free sector found
+   the same way.  Returns the number of sectors allocated, which is
+   0 if the disk is full even after reclaiming the sectors that
+   open files hold in reserve. */
+size_t free_map_allocate_run (size_t max_cnt, block_sector_t hint,
+                              block_sector_t *sectorp)
+{
+  size_t cnt = allocate_run (max_cnt, hint, sectorp);
+
+  if (cnt == 0 && inode_reclaim_prealloc ())
+    cnt = allocate_run (max_cnt, hint, sectorp);
+  return cnt;
+}
+
 /* Makes CNT sectors starting at SECTOR available for use. */
 void free_map_release (block_sector_t sector, size_t cnt)
 {
+  lock_acquire (&free_map_lock);
   ASSERT (bitmap_all (free_map, sector, cnt));
   bitmap_set_multiple (free_map, sector, cnt, false);
-  bitmap_write (free_map, free_map_file);
+  mark_dirty (sector, cnt);
+  account_groups (sector, cnt, false);
+  lock_release (&free_map_lock);
+}
+
+/* Writes the changed parts of the free map to the free map file,
+   one write per run of consecutive changed sectors.  If the file
+   system has a journal, only a commit may call this, so that the
+   free map changes join its transaction. */
+void free_map_flush (void)
+{
+  off_t size = bitmap_file_size (free_map);
+  size_t first, end;
+
+  lock_acquire (&free_map_lock);
+  for (first = bitmap_scan (dirty_map, 0, 1, true); first != BITMAP_ERROR;
+       first = bitmap_scan (dirty_map, end, 1, true))
+    {
+      off_t ofs, len;
+
+      end = bitmap_scan (dirty_map, first, 1, false);
+      if (end == BITMAP_ERROR)
+        end = bitmap_size (dirty_map);
+      ofs = first * BLOCK_SECTOR_SIZE;
+      len = end * BLOCK_SECTOR_SIZE;
+      if (len > size)
+        len = size;
+      len -= ofs;
+      if (file_write_at (free_map_file, (uint8_t *) free_map->bits + ofs, len,
+                         ofs) != len)
+        PANIC ("can't write free map");
+      bitmap_set_multiple (dirty_map, first, end - first, false);
+    }
+  lock_release (&free_map_lock);
 }
 
 /* Opens the free map file and reads it from disk. */
@@ -87,10 +321,18 @@ void free_map_open (void)
     PANIC ("can't open free map");
   if (!bitmap_read (free_map, free_map_file))
     PANIC ("can't read free map");
+  count_groups ();
 }
 
 /* Writes the free map to disk and closes the free map file. */
-void free_map_close (void) { file_close (free_map_file); }
+void free_map_close (void)
+{
+  if (journal_active ())
+    journal_commit ();
+  else
+    free_map_flush ();
+  file_close (free_map_file);
+}
 
 /* Creates a new free map file on disk and writes the free map to
    it. */
@@ -106,4 +348,5 @@ void free_map_create (void)
     PANIC ("can't open free map");
   if (!bitmap_write (free_map, free_map_file))
     PANIC ("can't write free map");
+  bitmap_set_all (dirty_map, false);
 }
@@ -1,14 +1,43 @@
 #include "filesys/inode.h"
-#include <list.h>
+#include <hash.h>
 #include <debug.h>
 #include <round.h>
 #include <string.h>
+#include "filesys/cache.h"
 #include "filesys/filesys.h"
 #include "filesys/free-map.h"
 #include "threads/malloc.h"
 
-/* Identifies an inode. */
-#define INODE_MAGIC 0x494e4f44
+/* Identifies an inode.  Changed whenever struct inode_disk changes,
+   so that an inode written in an older layout is refused instead of
+   misread. */
+#define INODE_MAGIC 0x494e4f46
+
+/* Identifies an extent-based inode. */
+#define INODE_EXTENT_MAGIC 0x494e4f47
+
+/* Overflow block holding extents that do not fit in an
+   extent-based inode.  Must be exactly BLOCK_SECTOR_SIZE bytes
+   long. */
+#define EXTENTS_PER_BLOCK                                                      \
+  ((BLOCK_SECTOR_SIZE - sizeof (block_sector_t)) / sizeof (struct extent))
+struct extent_block
+{
+  block_sector_t next; /* Next overflow block, or UNALLOCATED_SECTOR. */
+  struct extent extents[EXTENTS_PER_BLOCK];
+  uint8_t unused[BLOCK_SECTOR_SIZE - sizeof (block_sector_t) -
+                 EXTENTS_PER_BLOCK * sizeof (struct extent)];
+};
+
+/* True if inodes created from now on use the extent layout. */
+static bool use_extents;
+
+/* Number of sectors an open inode reserves the first time it
+   grows.  Each refill doubles the reservation, up to
+   PREALLOC_MAX_SECTORS, so files that keep growing get longer
+   runs. */
+#define PREALLOC_SECTORS 16
+#define PREALLOC_MAX_SECTORS 128
 
 /* Returns the number of sectors to allocate for an inode SIZE
    bytes long. */
@@ -17,121 +46,631 @@ static inline size_t bytes_to_sectors (off_t size)
   return DIV_ROUND_UP (size, BLOCK_SECTOR_SIZE);
 }
 
+/* Returns the number of index blocks that an indexed inode SIZE
+   bytes long needs. */
+static size_t index_sectors (off_t size)
+{
+  size_t sectors = bytes_to_sectors (size);
+
+  if (sectors <= NUM_DIRECT_INDICES)
+    return 0;
+  sectors -= NUM_DIRECT_INDICES;
+  if (sectors <= INDICES_PER_BLOCK)
+    return 1;
+  sectors -= INDICES_PER_BLOCK;
+  if (sectors <= INDICES_PER_BLOCK * INDICES_PER_BLOCK)
+    return 2 + DIV_ROUND_UP (sectors, INDICES_PER_BLOCK);
+  sectors -= INDICES_PER_BLOCK * INDICES_PER_BLOCK;
+  return 3 + INDICES_PER_BLOCK + DIV_ROUND_UP (sectors, INDICES_PER_BLOCK) +
+         DIV_ROUND_UP (sectors, INDICES_PER_BLOCK * INDICES_PER_BLOCK);
+}
+
+/* Takes up to CNT consecutive sectors from the front of
+   preallocation window PA, first refilling PA from the free map
+   if it is empty.  A refill reserves max(CNT, PA->fill) sectors if
+   possible, starting at PA->start if that sector is free so that
+   growth stays contiguous, and then doubles PA->fill up to
+   PREALLOC_MAX_SECTORS.  Stores the first sector taken into
+   *SECTORP and returns the number taken, which is 0 if the disk
+   is full. */
+static size_t prealloc_take (struct prealloc *pa, size_t cnt,
+                             block_sector_t *sectorp)
+{
+  if (pa->cnt == 0)
+    {
+      pa->cnt = free_map_allocate_run (cnt > pa->fill ? cnt : pa->fill,
+                                       pa->start, &pa->start);
+      if (pa->cnt == 0)
+        return 0;
+      if (pa->fill * 2 <= PREALLOC_MAX_SECTORS)
+        pa->fill *= 2;
+    }
+  if (cnt > pa->cnt)
+    cnt = pa->cnt;
+  *sectorp = pa->start;
+  pa->start += cnt;
+  pa->cnt -= cnt;
+  return cnt;
+}
+
+/* Returns the sectors still reserved in PA to the free map. */
+static void prealloc_release (struct prealloc *pa)
+{
+  if (pa->cnt > 0)
+    free_map_release (pa->start, pa->cnt);
+  pa->cnt = 0;
+}
+
 // Vincent driving
-/* Fills given sector with provided val */
+/* Fills given index sector with provided val, which must be 0 or
+   UNALLOCATED_SECTOR, in the buffer cache without reading it */
 inline void set_block_val (block_sector_t sector, block_sector_t val)
 {
-  block_sector_t buffer[INDICES_PER_BLOCK];
-  ASSERT (sizeof (buffer) == BLOCK_SECTOR_SIZE);
-  for (int i = 0; i < INDICES_PER_BLOCK; i++)
+  ASSERT (val == 0 || val == UNALLOCATED_SECTOR);
+  cache_fill (sector, val & 0xff, true);
+}
+
+/* Returns true if INODE's data is metadata, whose changes are
+   committed through the journal. */
+static bool inode_is_meta (const struct inode *inode)
+{
+  return inode->data.is_directory || inode->sector == FREE_MAP_SECTOR;
+}
+
+/* Zeroes newly allocated data SECTOR, which holds sector IDX of
+   INODE's data, if INODE is already initialized past IDX.
+   Sectors past the initialized part need no zeroing, since they
+   read as zeros until inode_write_at() first writes them. */
+static void init_data_sector (const struct inode *inode, off_t idx,
+                              block_sector_t sector)
+{
+  if ((block_sector_t) idx < inode->data.init_cnt)
+    cache_fill (sector, 0, inode_is_meta (inode));
+}
+
+/* Returns the contents of INODE's index block SECTOR, decoded
+   from INODE's index cache if possible and otherwise read through
+   the buffer cache into the least recently used slot.  SCRATCH is
+   used instead of a slot if memory for the slot cannot be
+   allocated, or if INODE is a null pointer because the inode is
+   still being created.  INODE's index lock must be held. */
+static block_sector_t *index_get (struct inode *inode, block_sector_t sector,
+                                  block_sector_t scratch[])
+{
+  struct index_slot *victim;
+
+  if (inode == NULL)
     {
-      buffer[i] = val;
+      cache_read (sector, scratch);
+      return scratch;
     }
-  block_write (fs_device, sector, buffer);
+
+  victim = &inode->index_cache[0];
+  for (int i = 0; i < INDEX_CACHE_SLOTS; i++)
+    {
+      struct index_slot *slot = &inode->index_cache[i];
+      if (slot->sector == sector)
+        {
+          slot->last_use = ++inode->index_clock;
+          return slot->map;
+        }
+      if (slot->last_use < victim->last_use)
+        victim = slot;
+    }
+
+  if (victim->map == NULL)
+    victim->map = malloc (BLOCK_SECTOR_SIZE);
+  if (victim->map == NULL)
+    {
+      cache_read (sector, scratch);
+      return scratch;
+    }
+  cache_read (sector, victim->map);
+  victim->sector = sector;
+  victim->last_use = ++inode->index_clock;
+  return victim->map;
 }
 
-/* Returns the block device sector that contains byte offset POS
-   within INODE.
-   Returns -1 if INODE does not contain data for a byte at offset
-   POS. */
-static block_sector_t byte_to_sector (const struct inode *inode, off_t pos,
-                                      bool allocate)
+/* Sets entry IDX of index block SECTOR, whose contents were
+   returned in MAP by index_get(), to VALUE, writing the change
+   through to the buffer cache. */
+static void index_set (block_sector_t sector, block_sector_t *map, off_t idx,
+                       block_sector_t value)
 {
-  ASSERT (inode != NULL);
-  if (pos >= MX_FILE_LEN)
+  map[idx] = value;
+  cache_write_at (sector, &map[idx], idx * sizeof *map, sizeof *map, true);
+}
+
+/* Writes the SIZE bytes at FIELD, which lies within MAP, the
+   in-memory copy of index block SECTOR, through to the buffer
+   cache. */
+static void index_write (block_sector_t sector, const void *map,
+                         const void *field, size_t size)
+{
+  off_t ofs = (const uint8_t *) field - (const uint8_t *) map;
+  cache_write_at (sector, field, ofs, size, true);
+}
+
+/* Returns overflow block N of extent-based inode DISK, which is
+   the content of INODE or, while it is being created, of no
+   inode at all, and stores its sector in *SECTORP. */
+static struct extent_block *extent_block_get (struct inode *inode,
+                                              const struct inode_disk *disk,
+                                              size_t n, block_sector_t *sectorp,
+                                              block_sector_t scratch[])
+{
+  block_sector_t sector = disk->extent_block;
+  struct extent_block *eb = (struct extent_block *) index_get (inode, sector,
+                                                               scratch);
+  while (n-- > 0)
     {
-      return -1;
+      sector = eb->next;
+      eb = (struct extent_block *) index_get (inode, sector, scratch);
     }
-  // Matthew driving
-  // direct indices
-  pos /= BLOCK_SECTOR_SIZE;
-  if (pos < NUM_DIRECT_INDICES)
+  *sectorp = sector;
+  return eb;
+}
+
+/* Returns the sector that holds sector IDX of extent-based
+   INODE's data, or UNALLOCATED_SECTOR if the extents do not
+   reach that far.  The search resumes from INODE's extent hint if
+   IDX lies at or past it, so that sequential access does not walk
+   every earlier extent again.  INODE's index lock must be held. */
+static block_sector_t extent_lookup (struct inode *inode, off_t idx)
+{
+  const struct inode_disk *disk = &inode->data;
+  struct extent_hint *hint = &inode->extent_hint;
+  block_sector_t scratch[INDICES_PER_BLOCK];
+  const struct extent *ext = disk->extents;
+  size_t ext_left = NUM_INODE_EXTENTS; /* Extents left in EXT's array. */
+  block_sector_t block = UNALLOCATED_SECTOR; /* Block holding EXT. */
+  block_sector_t next = disk->extent_block;
+  block_sector_t first = 0; /* File sector at which EXT starts. */
+  uint32_t i = 0;
+
+  if ((block_sector_t) idx >= disk->sector_cnt)
+    return UNALLOCATED_SECTOR;
+
+  if (hint->idx < disk->extent_cnt && (block_sector_t) idx >= hint->first)
     {
-      if (inode->data.direct_pointers[pos] == UNALLOCATED_SECTOR && allocate)
+      i = hint->idx;
+      first = hint->first;
+      block = hint->block;
+      if (i < NUM_INODE_EXTENTS)
+        {
+          ext = disk->extents + i;
+          ext_left = NUM_INODE_EXTENTS - i;
+        }
+      else
         {
-          if (free_map_allocate (1, &inode->data.direct_pointers[pos]))
+          struct extent_block *eb =
+              (struct extent_block *) index_get (inode, block, scratch);
+          size_t ofs = (i - NUM_INODE_EXTENTS) % EXTENTS_PER_BLOCK;
+          ext = eb->extents + ofs;
+          ext_left = EXTENTS_PER_BLOCK - ofs;
+          next = eb->next;
+        }
+    }
+
+  for (; i < disk->extent_cnt; i++)
+    {
+      if (ext_left == 0)
+        {
+          struct extent_block *eb =
+              (struct extent_block *) index_get (inode, next, scratch);
+          block = next;
+          ext = eb->extents;
+          ext_left = EXTENTS_PER_BLOCK;
+          next = eb->next;
+        }
+      if ((block_sector_t) idx - first < ext->length)
+        {
+          hint->idx = i;
+          hint->first = first;
+          hint->block = block;
+          return ext->start + (idx - first);
+        }
+      first += ext->length;
+      ext++;
+      ext_left--;
+    }
+  NOT_REACHED ();
+}
+
+/* Appends the CNT sectors starting at START to the end of
+   extent-based inode DISK, which is the content of INODE or of no
+   inode at all.  The run is merged into the last extent if it
+   continues it.  Returns false if an overflow block is needed
+   and cannot be allocated. */
+static bool extent_append (struct inode *inode, struct inode_disk *disk,
+                           block_sector_t start, block_sector_t cnt)
+{
+  block_sector_t scratch[INDICES_PER_BLOCK];
+  struct extent_block *eb;
+  block_sector_t eb_sector;
+  size_t i = disk->extent_cnt;
+
+  if (i > 0)
+    {
+      struct extent *last;
+      if (i <= NUM_INODE_EXTENTS)
+        last = &disk->extents[i - 1];
+      else
+        {
+          size_t ofs = i - 1 - NUM_INODE_EXTENTS;
+          eb = extent_block_get (inode, disk, ofs / EXTENTS_PER_BLOCK,
+                                 &eb_sector, scratch);
+          last = &eb->extents[ofs % EXTENTS_PER_BLOCK];
+        }
+      if (last->start + last->length == start)
+        {
+          last->length += cnt;
+          if (i > NUM_INODE_EXTENTS)
+            index_write (eb_sector, eb, &last->length, sizeof last->length);
+          return true;
+        }
+    }
+
+  if (i < NUM_INODE_EXTENTS)
+    {
+      disk->extents[i].start = start;
+      disk->extents[i].length = cnt;
+      disk->extent_cnt++;
+      return true;
+    }
+
+  i -= NUM_INODE_EXTENTS;
+  if (i % EXTENTS_PER_BLOCK == 0)
+    {
+      /* Chain on a new overflow block. */
+      block_sector_t new_sector;
+      if (!free_map_allocate (1, start, &new_sector))
+        return false;
+      set_block_val (new_sector, UNALLOCATED_SECTOR);
+      if (i == 0)
+        disk->extent_block = new_sector;
+      else
+        {
+          eb = extent_block_get (inode, disk, i / EXTENTS_PER_BLOCK - 1,
+                                 &eb_sector, scratch);
+          eb->next = new_sector;
+          index_write (eb_sector, eb, &eb->next, sizeof eb->next);
+        }
+    }
+  eb = extent_block_get (inode, disk, i / EXTENTS_PER_BLOCK, &eb_sector,
+                         scratch);
+  eb->extents[i % EXTENTS_PER_BLOCK].start = start;
+  eb->extents[i % EXTENTS_PER_BLOCK].length = cnt;
+  index_write (eb_sector, eb, &eb->extents[i % EXTENTS_PER_BLOCK],
+               sizeof (struct extent));
+  disk->extent_cnt++;
+  return true;
+}
+
+/* Extends extent-based inode DISK, which is the content of INODE
+   or of no inode at all, with sectors taken from PA until it maps
+   at least SECTORS sectors.  The new sectors lie past DISK's
+   initialized part, so they need no zeroing.  Refills of PA prefer the
+   sectors just past the last extent.  Returns false if the disk is
+   full. */
+static bool extent_grow (struct inode *inode, struct inode_disk *disk,
+                         size_t sectors, struct prealloc *pa)
+{
+  while (disk->sector_cnt < sectors)
+    {
+      block_sector_t scratch[INDICES_PER_BLOCK];
+      block_sector_t start;
+      size_t cnt;
+
+      /* Refill the window just past the last extent if possible. */
+      if (disk->extent_cnt > 0 && pa->cnt == 0)
+        {
+          size_t i = disk->extent_cnt - 1;
+          const struct extent *last;
+          if (i < NUM_INODE_EXTENTS)
+            last = &disk->extents[i];
+          else
             {
-              set_block_val (inode->data.direct_pointers[pos], 0);
+              block_sector_t eb_sector;
+              struct extent_block *eb = extent_block_get (
+                  inode, disk, (i - NUM_INODE_EXTENTS) / EXTENTS_PER_BLOCK,
+                  &eb_sector, scratch);
+              last = &eb->extents[(i - NUM_INODE_EXTENTS) % EXTENTS_PER_BLOCK];
             }
+          pa->start = last->start + last->length;
         }
-      return inode->data.direct_pointers[pos];
+
+      cnt = prealloc_take (pa, sectors - disk->sector_cnt, &start);
+      if (cnt == 0)
+        return false;
+      if (!extent_append (inode, disk, start, cnt))
+        {
+          free_map_release (start, cnt);
+          return false;
+        }
+      disk->sector_cnt += cnt;
     }
-  pos -= NUM_DIRECT_INDICES;
+  return true;
+}
 
-  // level one pointer
-  if (pos < INDICES_PER_BLOCK)
+/* Releases every sector mapped by extent-based inode DISK, which
+   is the content of INODE or of no inode at all, along with its
+   overflow blocks. */
+static void extent_free (struct inode *inode, const struct inode_disk *disk)
+{
+  block_sector_t scratch[INDICES_PER_BLOCK];
+  size_t left = disk->extent_cnt;
+  block_sector_t sector = disk->extent_block;
+
+  for (size_t i = 0; i < NUM_INODE_EXTENTS && left > 0; i++, left--)
+    free_map_release (disk->extents[i].start, disk->extents[i].length);
+  while (left > 0)
+    {
+      struct extent_block *eb =
+          (struct extent_block *) index_get (inode, sector, scratch);
+      block_sector_t next = eb->next;
+
+      for (size_t i = 0; i < EXTENTS_PER_BLOCK && left > 0; i++, left--)
+        free_map_release (eb->extents[i].start, eb->extents[i].length);
+      free_map_release (sector, 1);
+      sector = next;
+    }
+}
+
+/* Returns the block device sector that holds sector IDX of
+   INODE's data, which is entry POS of the LVL-level index tree
+   whose root block is stored in *ROOTP, allocating the sector and
+   any missing index blocks on the way to it if ALLOCATE is true.
+   Returns UNALLOCATED_SECTOR if there is no such sector.  INODE's
+   index lock must be held. */
+static block_sector_t lookup_indirect (struct inode *inode,
+                                       block_sector_t *rootp, uint32_t lvl,
+                                       off_t pos, off_t idx, bool allocate)
+{
+  block_sector_t scratch[INDICES_PER_BLOCK];
+  block_sector_t *map;
+  block_sector_t new_sector;
+  struct prealloc *pa = &inode->prealloc;
+  block_sector_t sector;
+  off_t span = 1; /* Data sectors reached through each entry. */
+
+  for (uint32_t i = 1; i < lvl; i++)
+    span *= INDICES_PER_BLOCK;
+
+  if (*rootp == UNALLOCATED_SECTOR)
+    {
+      if (!allocate || !prealloc_take (pa, 1, rootp))
+        {
+          return UNALLOCATED_SECTOR;
+        }
+      set_block_val (*rootp, UNALLOCATED_SECTOR);
+    }
+
+  // Vincent driving
+  /* Walk down to the level one block, allocating index blocks
+     that are missing. */
+  sector = *rootp;
+  for (; lvl > 1; lvl--, span /= INDICES_PER_BLOCK)
     {
-      if (inode->data.levelone_pointer == UNALLOCATED_SECTOR)
+      off_t i = pos / span;
+      pos %= span;
+      map = index_get (inode, sector, scratch);
+      if (map[i] == UNALLOCATED_SECTOR)
         {
-          if (!allocate ||
-              !free_map_allocate (1, &inode->data.levelone_pointer))
+          if (!allocate || !prealloc_take (pa, 1, &new_sector))
             {
               return UNALLOCATED_SECTOR;
             }
-          set_block_val (inode->data.levelone_pointer, UNALLOCATED_SECTOR);
+          set_block_val (new_sector, UNALLOCATED_SECTOR);
+          index_set (sector, map, i, new_sector);
         }
-      block_sector_t buffer[INDICES_PER_BLOCK];
-      block_read (fs_device, inode->data.levelone_pointer, buffer);
-      // Matthew driving
-      if (buffer[pos] == UNALLOCATED_SECTOR && allocate)
+      sector = map[i];
+    }
+
+  // Matthew driving
+  map = index_get (inode, sector, scratch);
+  if (map[pos] == UNALLOCATED_SECTOR && allocate)
+    {
+      if (prealloc_take (pa, 1, &new_sector))
+        {
+          init_data_sector (inode, idx, new_sector);
+          index_set (sector, map, pos, new_sector);
+        }
+    }
+  return map[pos];
+}
+
+/* Returns the block device sector that holds sector IDX of
+   INODE's data, allocating it if it is missing and ALLOCATE is
+   true.  Returns UNALLOCATED_SECTOR if there is no such sector.
+   INODE's index lock must be held. */
+static block_sector_t lookup_sector (struct inode *inode, off_t pos,
+                                     bool allocate)
+{
+  struct prealloc *pa = &inode->prealloc;
+  off_t idx = pos;
+
+  // Matthew driving
+  // direct indices
+  if (pos < NUM_DIRECT_INDICES)
+    {
+      if (inode->data.direct_pointers[pos] == UNALLOCATED_SECTOR && allocate)
         {
-          if (free_map_allocate (1, &buffer[pos]))
+          if (prealloc_take (pa, 1, &inode->data.direct_pointers[pos]))
             {
-              set_block_val (buffer[pos], 0);
-              block_write (fs_device, inode->data.levelone_pointer, buffer);
+              init_data_sector (inode, idx, inode->data.direct_pointers[pos]);
             }
         }
-      return buffer[pos];
+      return inode->data.direct_pointers[pos];
     }
+  pos -= NUM_DIRECT_INDICES;
+
+  // level one pointer
+  if (pos < INDICES_PER_BLOCK)
+    return lookup_indirect (inode, &inode->data.levelone_pointer, 1, pos, idx,
+                            allocate);
   pos -= INDICES_PER_BLOCK;
 
   // level two pointer
-  if (inode->data.leveltwo_pointer == UNALLOCATED_SECTOR)
+  if (pos < INDICES_PER_BLOCK * INDICES_PER_BLOCK)
+    return lookup_indirect (inode, &inode->data.leveltwo_pointer, 2, pos, idx,
+                            allocate);
+  pos -= INDICES_PER_BLOCK * INDICES_PER_BLOCK;
+
+  // level three pointer
+  return lookup_indirect (inode, &inode->data.levelthree_pointer, 3, pos, idx,
+                          allocate);
+}
+
+/* Returns the block device sector that contains byte offset POS
+   within INODE, allocating it if it is missing and ALLOCATE is
+   true.
+   Returns -1 if INODE does not contain data for a byte at offset
+   POS. */
+static block_sector_t byte_to_sector (struct inode *inode, off_t pos,
+                                      bool allocate)
+{
+  block_sector_t sector;
+
+  ASSERT (inode != NULL);
+  ASSERT (!inode->data.is_inline);
+  if (pos >= MX_FILE_LEN)
     {
-      if (!allocate || !free_map_allocate (1, &inode->data.leveltwo_pointer))
-        {
-          return UNALLOCATED_SECTOR;
-        }
-      set_block_val (inode->data.leveltwo_pointer, UNALLOCATED_SECTOR);
+      return -1;
     }
-  block_sector_t buffer[INDICES_PER_BLOCK];
-  // Vincent driving
-  block_read (fs_device, inode->data.leveltwo_pointer, buffer);
-  off_t lvl_2_idx = pos / INDICES_PER_BLOCK;
-  off_t lvl_1_idx = pos % INDICES_PER_BLOCK;
-  if (buffer[lvl_2_idx] == UNALLOCATED_SECTOR)
+  pos /= BLOCK_SECTOR_SIZE;
+  lock_acquire (&inode->index_lock);
+  if (inode_has_extents (inode))
+    {
+      sector = extent_lookup (inode, pos);
+      if (sector == UNALLOCATED_SECTOR && allocate &&
+          extent_grow (inode, &inode->data, pos + 1, &inode->prealloc))
+        sector = extent_lookup (inode, pos);
+    }
+  else
+    sector = lookup_sector (inode, pos, allocate);
+  lock_release (&inode->index_lock);
+  return sector;
+}
+
+/* Number of separately locked parts of the open inode table. */
+#define INODE_STRIPES 16
+
+/* Open inodes, so that opening a single inode twice returns the
+   same `struct inode'.  Inodes are spread over INODE_STRIPES hash
+   tables by sector number, each with its own lock, so that
+   opening and closing unrelated inodes rarely contend. */
+static struct inode_stripe
+{
+  struct hash inodes; /* Open inodes in this stripe. */
+  struct lock lock;   /* Protects INODES; held while an OPEN_CNT drops to 0. */
+} inode_stripes[INODE_STRIPES];
+
+/* Returns a hash value for inode E, keyed on its sector. */
+static unsigned inode_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+  return hash_int (hash_entry (e, struct inode, elem)->sector);
+}
+
+/* Orders inodes by sector number. */
+static bool inode_less (const struct hash_elem *a, const struct hash_elem *b,
+                        void *aux UNUSED)
+{
+  return hash_entry (a, struct inode, elem)->sector <
+         hash_entry (b, struct inode, elem)->sector;
+}
+
+/* Returns the open inode table stripe that holds SECTOR. */
+static struct inode_stripe *inode_stripe (block_sector_t sector)
+{
+  return &inode_stripes[hash_int (sector) % INODE_STRIPES];
+}
+
+/* Initializes the inode module. */
+void inode_init (void)
+{
+  for (int i = 0; i < INODE_STRIPES; i++)
+    {
+      if (!hash_init (&inode_stripes[i].inodes, inode_hash, inode_less, NULL))
+        PANIC ("couldn't allocate open inode table");
+      lock_init (&inode_stripes[i].lock);
+    }
+}
+
+/* Returns the sectors reserved by every open inode to the free
+   map, so that they are not recorded as in use on disk. */
+void inode_done (void)
+{
+  for (int i = 0; i < INODE_STRIPES; i++)
     {
-      if (!allocate || !free_map_allocate (1, &buffer[lvl_2_idx]))
+      struct inode_stripe *stripe = &inode_stripes[i];
+      struct hash_iterator it;
+
+      lock_acquire (&stripe->lock);
+      hash_first (&it, &stripe->inodes);
+      while (hash_next (&it))
         {
-          return UNALLOCATED_SECTOR;
+          struct inode *inode = hash_entry (hash_cur (&it), struct inode, elem);
+          if (!inode->removed)
+            cache_write (inode->sector, &inode->data, true);
+          lock_acquire (&inode->index_lock);
+          prealloc_release (&inode->prealloc);
+          lock_release (&inode->index_lock);
         }
-      block_write (fs_device, inode->data.leveltwo_pointer, buffer);
-      set_block_val (buffer[lvl_2_idx], UNALLOCATED_SECTOR);
+      lock_release (&stripe->lock);
     }
-  block_sector_t save_sector = buffer[lvl_2_idx];
-  block_read (fs_device, buffer[lvl_2_idx], buffer);
-  if (buffer[lvl_1_idx] == UNALLOCATED_SECTOR && allocate)
+}
+
+/* Returns to the free map the sectors reserved for the growth of
+   open inodes, so that the disk is not reported full while open
+   files hold free sectors in reserve.  Skips inodes and table
+   stripes whose locks are held, since the caller may already hold
+   some of them.  Returns true if any sectors were released. */
+bool inode_reclaim_prealloc (void)
+{
+  bool released = false;
+
+  for (int i = 0; i < INODE_STRIPES; i++)
     {
-      if (free_map_allocate (1, &buffer[lvl_1_idx]))
+      struct inode_stripe *stripe = &inode_stripes[i];
+      struct hash_iterator it;
+
+      if (lock_held_by_current_thread (&stripe->lock) ||
+          !lock_try_acquire (&stripe->lock))
+        continue;
+      hash_first (&it, &stripe->inodes);
+      while (hash_next (&it))
         {
-          set_block_val (buffer[lvl_1_idx], 0);
-          block_write (fs_device, save_sector, buffer);
+          struct inode *inode = hash_entry (hash_cur (&it), struct inode, elem);
+          if (lock_held_by_current_thread (&inode->index_lock) ||
+              !lock_try_acquire (&inode->index_lock))
+            continue;
+          if (inode->prealloc.cnt > 0)
+            {
+              prealloc_release (&inode->prealloc);
+              released = true;
+            }
+          lock_release (&inode->index_lock);
         }
+      lock_release (&stripe->lock);
     }
-  return buffer[lvl_1_idx];
+  return released;
 }
 
-/* List of open inodes, so that opening a single inode twice
-   returns the same `struct inode'. */
-static struct list open_inodes;
+/* Selects the extent layout for inodes created from now on if
+   EXTENTS is true, or the indexed layout otherwise. */
+void inode_set_extents (bool extents) { use_extents = extents; }
 
-static struct lock inode_list_access;
+/* Returns true if INODE uses the extent layout. */
+bool inode_has_extents (const struct inode *inode)
+{
+  return inode->data.magic == INODE_EXTENT_MAGIC;
+}
 
-/* Initializes the inode module. */
-void inode_init (void)
+/* Returns true if INODE's data is stored in the inode itself. */
+bool inode_is_inline (const struct inode *inode)
 {
-  list_init (&open_inodes);
-  lock_init (&inode_list_access);
+  return inode->data.is_inline;
 }
 
 /* Releases sectors held by sector, given that sector is a level lvl index */
@@ -147,7 +686,7 @@ void free_index (block_sector_t sector, uint32_t lvl)
       return;
     }
   block_sector_t buffer[INDICES_PER_BLOCK];
-  block_read (fs_device, sector, buffer);
+  cache_read (sector, buffer);
   for (int i = 0; i < INDICES_PER_BLOCK; i++)
     {
       if (buffer[i] != UNALLOCATED_SECTOR)
@@ -157,10 +696,11 @@ void free_index (block_sector_t sector, uint32_t lvl)
 }
 
 /* Allocates an indirect index of level lvl that will store sectors
-sectors. If sectors is greater than what can be stored by the index,
-as much is allocated as possible. If allocation fails, returns
-UNALLOCATED_SECTOR */
-block_sector_t create_index (size_t sectors, uint32_t lvl)
+sectors, taking sectors from pa. If sectors is greater than what can
+be stored by the index, as much is allocated as possible. If
+allocation fails, returns UNALLOCATED_SECTOR */
+static block_sector_t create_index (size_t sectors, uint32_t lvl,
+                                    struct prealloc *pa)
 {
   // Vincent driving
   if (sectors == 0)
@@ -169,7 +709,7 @@ block_sector_t create_index (size_t sectors, uint32_t lvl)
     }
   block_sector_t retval = UNALLOCATED_SECTOR;
 
-  free_map_allocate (1, &retval);
+  prealloc_take (pa, 1, &retval);
   if (lvl == 0 || retval == UNALLOCATED_SECTOR)
     {
       return retval;
@@ -189,7 +729,7 @@ block_sector_t create_index (size_t sectors, uint32_t lvl)
         {
           uint32_t remove =
               sectors >= sectors_in_index ? sectors_in_index : sectors;
-          buffer[i] = create_index (remove, lvl - 1);
+          buffer[i] = create_index (remove, lvl - 1, pa);
           // Matthew driving
           if (buffer[i] == UNALLOCATED_SECTOR)
             {
@@ -199,7 +739,7 @@ block_sector_t create_index (size_t sectors, uint32_t lvl)
           sectors -= remove;
         }
     }
-  block_write (fs_device, retval, buffer);
+  cache_write (retval, buffer, true);
   if (!good)
     {
       free_index (retval, lvl);
@@ -216,14 +756,52 @@ block_sector_t create_index (size_t sectors, uint32_t lvl)
 bool inode_create (block_sector_t sector, off_t length)
 {
   struct inode_disk *disk_inode = NULL;
-  ASSERT (length >= 0);
-  ASSERT (length < MX_FILE_LEN);
+  struct prealloc pa;
+  ASSERT (length >= 0 && length <= MX_FILE_LEN);
 
   /* If this assertion fails, the inode structure is not exactly
      one sector in size, and you should fix that. */
   ASSERT (sizeof *disk_inode == BLOCK_SECTOR_SIZE);
+  ASSERT (sizeof (struct extent_block) == BLOCK_SECTOR_SIZE);
   disk_inode = calloc (1, sizeof *disk_inode);
   if (disk_inode != NULL)
+    disk_inode->init_cnt = 0;
+
+  /* Reserve every sector the inode needs up front, so that they
+     are allocated as one run if the free map allows. */
+  pa.start = sector + 1;
+  pa.cnt = 0;
+  pa.fill = bytes_to_sectors (length) + index_sectors (length);
+
+  if (disk_inode != NULL && length <= (off_t) INODE_INLINE_BYTES)
+    {
+      /* Small files keep their data in the inode until they
+         grow. */
+      disk_inode->is_inline = true;
+      disk_inode->magic = use_extents ? INODE_EXTENT_MAGIC : INODE_MAGIC;
+      disk_inode->length = length;
+      cache_write (sector, disk_inode, true);
+      free (disk_inode);
+      return true;
+    }
+  else if (disk_inode != NULL && use_extents)
+    {
+      disk_inode->magic = INODE_EXTENT_MAGIC;
+      disk_inode->length = length;
+      disk_inode->extent_block = UNALLOCATED_SECTOR;
+      if (!extent_grow (NULL, disk_inode, bytes_to_sectors (length), &pa))
+        {
+          extent_free (NULL, disk_inode);
+          prealloc_release (&pa);
+          free (disk_inode);
+          return false;
+        }
+      prealloc_release (&pa);
+      cache_write (sector, disk_inode, true);
+      free (disk_inode);
+      return true;
+    }
+  else if (disk_inode != NULL)
     {
       disk_inode->is_directory = false;
       size_t sectors = bytes_to_sectors (length);
@@ -236,12 +814,12 @@ bool inode_create (block_sector_t sector, off_t length)
           disk_inode->direct_pointers[i] = UNALLOCATED_SECTOR;
         }
       disk_inode->levelone_pointer = disk_inode->leveltwo_pointer =
-          UNALLOCATED_SECTOR;
+          disk_inode->levelthree_pointer = UNALLOCATED_SECTOR;
 
       // Fill in direct indices
       for (int i = 0; i < NUM_DIRECT_INDICES && sectors; i++)
         {
-          disk_inode->direct_pointers[i] = create_index (sectors, 0);
+          disk_inode->direct_pointers[i] = create_index (sectors, 0, &pa);
           if (disk_inode->direct_pointers[i] == UNALLOCATED_SECTOR)
             {
               goto FAIL_ALLOCATION;
@@ -252,7 +830,7 @@ bool inode_create (block_sector_t sector, off_t length)
       // First layer indirect index
       if (sectors)
         {
-          disk_inode->levelone_pointer = create_index (sectors, 1);
+          disk_inode->levelone_pointer = create_index (sectors, 1, &pa);
           if (disk_inode->levelone_pointer == UNALLOCATED_SECTOR)
             {
               goto FAIL_ALLOCATION;
@@ -262,13 +840,26 @@ bool inode_create (block_sector_t sector, off_t length)
       // Second layer indirect index
       if (sectors)
         {
-          disk_inode->leveltwo_pointer = create_index (sectors, 2);
+          disk_inode->leveltwo_pointer = create_index (sectors, 2, &pa);
           if (disk_inode->leveltwo_pointer == UNALLOCATED_SECTOR)
             {
               goto FAIL_ALLOCATION;
             }
+          sectors -= sectors > INDICES_PER_BLOCK * INDICES_PER_BLOCK
+                         ? INDICES_PER_BLOCK * INDICES_PER_BLOCK
+                         : sectors;
         }
-      block_write (fs_device, sector, disk_inode);
+      // Third layer indirect index
+      if (sectors)
+        {
+          disk_inode->levelthree_pointer = create_index (sectors, 3, &pa);
+          if (disk_inode->levelthree_pointer == UNALLOCATED_SECTOR)
+            {
+              goto FAIL_ALLOCATION;
+            }
+        }
+      prealloc_release (&pa);
+      cache_write (sector, disk_inode, true);
       free (disk_inode);
       return true;
 
@@ -279,63 +870,92 @@ bool inode_create (block_sector_t sector, off_t length)
         }
       free_index (disk_inode->levelone_pointer, 1);
       free_index (disk_inode->leveltwo_pointer, 2);
+      free_index (disk_inode->levelthree_pointer, 3);
+      prealloc_release (&pa);
 
       free (disk_inode);
     }
   return false;
 }
 
+/* Returns INODE, just read in, if its magic number names a layout
+   this kernel understands.  Otherwise closes INODE and returns a
+   null pointer. */
+static struct inode *check_magic (struct inode *inode)
+{
+  if (inode->data.magic == INODE_MAGIC ||
+      inode->data.magic == INODE_EXTENT_MAGIC)
+    return inode;
+  inode_close (inode);
+  return NULL;
+}
+
 /* Reads an inode from SECTOR
    and returns a `struct inode' that contains it.
    Returns a null pointer if memory allocation fails. */
 struct inode *inode_open (block_sector_t sector)
 {
-  struct list_elem *e;
+  struct inode_stripe *stripe = inode_stripe (sector);
+  struct inode key;
+  struct hash_elem *e;
   struct inode *inode;
 
-  lock_acquire (&inode_list_access);
+  lock_acquire (&stripe->lock);
   /* Check whether this inode is already open. */
-  for (e = list_begin (&open_inodes); e != list_end (&open_inodes);
-       e = list_next (e))
+  key.sector = sector;
+  e = hash_find (&stripe->inodes, &key.elem);
+  if (e != NULL)
     {
-      inode = list_entry (e, struct inode, elem);
-      if (inode->sector == sector)
-        {
-          lock_release (&inode_list_access);
-          // Wait for inode to be read in if not read in yet
-          lock_acquire (&inode->block_op_wait);
-          lock_release (&inode->block_op_wait);
-          inode_reopen (inode);
-          return inode;
-        }
+      /* Reopen before releasing the stripe lock, so that the
+         inode cannot be freed by a concurrent last close. */
+      inode = inode_reopen (hash_entry (e, struct inode, elem));
+      lock_release (&stripe->lock);
+      // Wait for inode to be read in if not read in yet
+      lock_acquire (&inode->block_op_wait);
+      lock_release (&inode->block_op_wait);
+      return check_magic (inode);
     }
 
   /* Allocate memory. */
   inode = malloc (sizeof *inode);
   if (inode == NULL)
     {
-      lock_release (&inode_list_access);
+      lock_release (&stripe->lock);
       return NULL;
     }
 
   /* Initialize. */
-  list_push_front (&open_inodes, &inode->elem);
+  inode->sector = sector;
+  inode->open_cnt = 1;
+  lock_init (&inode->op_lock);
   lock_init (&inode->block_op_wait);
+  hash_insert (&stripe->inodes, &inode->elem);
   // Force other threads trying to get inode to wait for read to finish
   lock_acquire (&inode->block_op_wait);
-  // Avoid holding global lock shared by all inodes for too long
-  lock_release (&inode_list_access);
+  // Avoid holding the stripe lock for too long
+  lock_release (&stripe->lock);
 
-  inode->sector = sector;
-  inode->open_cnt = 1;
   inode->deny_write_cnt = 0;
   inode->removed = false;
-  lock_init (&inode->extend_write_lock);
-  lock_init (&inode->dir_lock);
-  lock_init (&inode->op_lock);
-  block_read (fs_device, inode->sector, &inode->data);
+  rwlock_init (&inode->rw_lock);
+  rwlock_init (&inode->dir_lock);
+  lock_init (&inode->index_lock);
+  for (int i = 0; i < INDEX_CACHE_SLOTS; i++)
+    {
+      inode->index_cache[i].sector = UNALLOCATED_SECTOR;
+      inode->index_cache[i].last_use = 0;
+      inode->index_cache[i].map = NULL;
+    }
+  inode->index_clock = 0;
+  inode->prealloc.start = inode->sector + 1;
+  inode->prealloc.cnt = 0;
+  inode->prealloc.fill = PREALLOC_SECTORS;
+  inode->extent_hint.idx = 0;
+  inode->extent_hint.first = 0;
+  inode->extent_hint.block = UNALLOCATED_SECTOR;
+  cache_read (inode->sector, &inode->data);
   lock_release (&inode->block_op_wait);
-  return inode;
+  return check_magic (inode);
 }
 
 /* Reopens and returns INODE. */
@@ -365,39 +985,55 @@ void inode_close (struct inode *inode)
   if (inode == NULL)
     return;
 
-  if (!inode->removed)
+  /* An inode refused by check_magic() is not ours to write. */
+  if (!inode->removed && (inode->data.magic == INODE_MAGIC ||
+                          inode->data.magic == INODE_EXTENT_MAGIC))
     {
-      block_write (fs_device, inode->sector, &inode->data);
+      cache_write (inode->sector, &inode->data, true);
     }
-  lock_acquire (&inode_list_access);
+  struct inode_stripe *stripe = inode_stripe (inode->sector);
+  lock_acquire (&stripe->lock);
   /* Release resources if this was the last opener. */
   lock_acquire (&inode->op_lock);
   if (--inode->open_cnt == 0)
     {
       lock_release (&inode->op_lock);
-      /* Remove from inode list and release lock. */
-      list_remove (&inode->elem);
-      lock_release (&inode_list_access);
+      /* Remove from open inode table and release lock. */
+      hash_delete (&stripe->inodes, &inode->elem);
+      lock_release (&stripe->lock);
+      prealloc_release (&inode->prealloc);
       /* Deallocate blocks if removed. */
       if (inode->removed)
         {
           free_map_release (inode->sector, 1);
 
-          // Matthew driving
-          for (int i = 0; i < NUM_DIRECT_INDICES; i++)
+          if (inode_is_inline (inode))
             {
-              if (inode->data.direct_pointers[i] != UNALLOCATED_SECTOR)
-                free_map_release (inode->data.direct_pointers[i], 1);
+              // Data was in the inode sector, which is already freed
+            }
+          else if (inode_has_extents (inode))
+            extent_free (inode, &inode->data);
+          else
+            {
+              // Matthew driving
+              for (int i = 0; i < NUM_DIRECT_INDICES; i++)
+                {
+                  if (inode->data.direct_pointers[i] != UNALLOCATED_SECTOR)
+                    free_map_release (inode->data.direct_pointers[i], 1);
+                }
+              free_index (inode->data.levelone_pointer, 1);
+              free_index (inode->data.leveltwo_pointer, 2);
+              free_index (inode->data.levelthree_pointer, 3);
             }
-          free_index (inode->data.levelone_pointer, 1);
-          free_index (inode->data.leveltwo_pointer, 2);
         }
+      for (int i = 0; i < INDEX_CACHE_SLOTS; i++)
+        free (inode->index_cache[i].map);
       free (inode);
     }
   else
     {
       lock_release (&inode->op_lock);
-      lock_release (&inode_list_access);
+      lock_release (&stripe->lock);
     }
 }
 
@@ -409,6 +1045,48 @@ void inode_remove (struct inode *inode)
   inode->removed = true;
 }
 
+/* Moves the data of inline INODE, which the caller must hold for
+   writing, into a newly allocated sector and switches INODE to the
+   layout named by its magic number.  Returns true if successful,
+   false if no sector could be allocated, in which case INODE is
+   left unchanged. */
+static bool inline_migrate (struct inode *inode)
+{
+  struct inode_disk *disk = &inode->data;
+  uint8_t data[INODE_INLINE_BYTES];
+
+  memcpy (data, disk->inline_data, sizeof data);
+  disk->is_inline = false;
+  disk->init_cnt = 0;
+  if (inode_has_extents (inode))
+    {
+      disk->sector_cnt = 0;
+      disk->extent_cnt = 0;
+      disk->extent_block = UNALLOCATED_SECTOR;
+    }
+  else
+    {
+      for (int i = 0; i < NUM_DIRECT_INDICES; i++)
+        disk->direct_pointers[i] = UNALLOCATED_SECTOR;
+      disk->levelone_pointer = disk->leveltwo_pointer =
+          disk->levelthree_pointer = UNALLOCATED_SECTOR;
+    }
+
+  if (disk->length > 0)
+    {
+      block_sector_t sector = byte_to_sector (inode, 0, true);
+      if (sector == UNALLOCATED_SECTOR)
+        {
+          disk->is_inline = true;
+          memcpy (disk->inline_data, data, sizeof data);
+          return false;
+        }
+      cache_write_new (sector, data, 0, disk->length, inode_is_meta (inode));
+      disk->init_cnt = 1;
+    }
+  return true;
+}
+
 /* Reads SIZE bytes from INODE into BUFFER, starting at position OFFSET.
    Returns the number of bytes actually read, which may be less
    than SIZE if an error occurs or end of file is reached. */
@@ -417,8 +1095,21 @@ off_t inode_read_at (struct inode *inode, void *buffer_, off_t size,
 {
   uint8_t *buffer = buffer_;
   off_t bytes_read = 0;
-  uint8_t *bounce = NULL;
 
+  rwlock_acquire_read (&inode->rw_lock);
+  if (inode->data.is_inline)
+    {
+      /* Small files are copied straight out of the inode. */
+      bytes_read = inode_length (inode) - offset;
+      if (bytes_read > size)
+        bytes_read = size;
+      if (bytes_read > 0)
+        memcpy (buffer, inode->data.inline_data + offset, bytes_read);
+      else
+        bytes_read = 0;
+      rwlock_release_read (&inode->rw_lock);
+      return bytes_read;
+    }
   while (size > 0)
     {
       int sector_ofs = offset % BLOCK_SECTOR_SIZE;
@@ -434,45 +1125,28 @@ off_t inode_read_at (struct inode *inode, void *buffer_, off_t size,
         break;
 
       // Vincent driving
-      /* Disk sector to read, starting byte offset within sector. */
-      block_sector_t sector_idx = byte_to_sector (inode, offset, false);
+      /* Disk sector to read, starting byte offset within sector.
+         Sectors that were never written need no lookup at all. */
+      block_sector_t sector_idx = UNALLOCATED_SECTOR;
+      if ((block_sector_t) (offset / BLOCK_SECTOR_SIZE) <
+          inode->data.init_cnt)
+        sector_idx = byte_to_sector (inode, offset, false);
       // Vincent driving
       if (sector_idx == UNALLOCATED_SECTOR)
         {
           // Block not allocated, just put zeros
-          for (int i = 0; i < chunk_size; i++)
-            {
-              *(buffer + bytes_read + i) = 0;
-            }
-          goto CONTINUE_LOOP;
-        }
-      if (sector_ofs == 0 && chunk_size == BLOCK_SECTOR_SIZE)
-        {
-          /* Read full sector directly into caller's buffer. */
-          block_read (fs_device, sector_idx, buffer + bytes_read);
+          memset (buffer + bytes_read, 0, chunk_size);
         }
       else
-        {
-          /* Read sector into bounce buffer, then partially copy
-             into caller's buffer. */
-          if (bounce == NULL)
-            {
-              bounce = malloc (BLOCK_SECTOR_SIZE);
-              if (bounce == NULL)
-                break;
-            }
-          block_read (fs_device, sector_idx, bounce);
-          memcpy (buffer + bytes_read, bounce + sector_ofs, chunk_size);
-        }
-
-    CONTINUE_LOOP:
+        cache_read_at (sector_idx, buffer + bytes_read, sector_ofs,
+                       chunk_size);
 
       /* Advance. */
       size -= chunk_size;
       offset += chunk_size;
       bytes_read += chunk_size;
     }
-  free (bounce);
+  rwlock_release_read (&inode->rw_lock);
 
   return bytes_read;
 }
@@ -485,18 +1159,49 @@ off_t inode_write_at (struct inode *inode, const void *buffer_, off_t size,
 {
   const uint8_t *buffer = buffer_;
   off_t bytes_written = 0;
-  uint8_t *bounce = NULL;
 
   if (inode->deny_write_cnt)
     return 0;
 
+  /* Clip the write to the largest possible file, which also keeps
+     OFFSET + SIZE from overflowing below. */
+  if (offset >= MX_FILE_LEN)
+    return 0;
+  if (size > MX_FILE_LEN - offset)
+    size = MX_FILE_LEN - offset;
+
   // Vincent driving
-  bool acquired_lock = false;
-  // Grow file
-  if (inode->data.length < size + offset)
+  /* Writes that grow the file, move init_cnt or change inline data
+     modify the inode, so they exclude everyone else.  Other writes
+     only touch data sectors, which the buffer cache keeps
+     consistent, and may run alongside readers.  Neither the length
+     nor init_cnt ever shrinks, so a write that needs no exclusive
+     access when checked still needs none once the lock is held. */
+  bool exclusive = inode->data.is_inline ||
+                   inode->data.length < size + offset ||
+                   (off_t) inode->data.init_cnt * BLOCK_SECTOR_SIZE <
+                       size + offset;
+  if (exclusive)
+    rwlock_acquire_write (&inode->rw_lock);
+  else
+    rwlock_acquire_read (&inode->rw_lock);
+
+  if (inode->data.is_inline)
     {
-      acquired_lock = true;
-      lock_acquire (&inode->extend_write_lock);
+      if (offset + size <= (off_t) INODE_INLINE_BYTES)
+        {
+          /* Still fits.  Put the inode in the buffer cache so that
+             the data is written back like any other. */
+          memcpy (inode->data.inline_data + offset, buffer, size);
+          bytes_written = size;
+          offset += size;
+          size = 0;
+          if (inode->data.length < offset)
+            inode->data.length = offset;
+          cache_write (inode->sector, &inode->data, true);
+        }
+      else if (!inline_migrate (inode))
+        size = 0;
     }
 
   while (size > 0)
@@ -518,31 +1223,27 @@ off_t inode_write_at (struct inode *inode, const void *buffer_, off_t size,
       if (chunk_size <= 0)
         break;
 
-      if (sector_ofs == 0 && chunk_size == BLOCK_SECTOR_SIZE)
+      /* The first write to a sector past the initialized part
+         supplies its initial contents, so it is not read from disk.
+         Allocated sectors skipped over on the way become
+         initialized too, and must be zeroed first. */
+      block_sector_t idx = offset / BLOCK_SECTOR_SIZE;
+      if (idx >= inode->data.init_cnt)
         {
-          /* Write full sector directly to disk. */
-          block_write (fs_device, sector_idx, buffer + bytes_written);
-        }
-      else
-        {
-          /* We need a bounce buffer. */
-          if (bounce == NULL)
+          for (; inode->data.init_cnt < idx; inode->data.init_cnt++)
             {
-              bounce = malloc (BLOCK_SECTOR_SIZE);
-              if (bounce == NULL)
-                break;
+              block_sector_t gap = byte_to_sector (
+                  inode, inode->data.init_cnt * BLOCK_SECTOR_SIZE, false);
+              if (gap != UNALLOCATED_SECTOR)
+                cache_fill (gap, 0, inode_is_meta (inode));
             }
-
-          /* If the sector contains data before or after the chunk
-             we're writing, then we need to read in the sector
-             first.  Otherwise we start with a sector of all zeros. */
-          if (sector_ofs > 0 || chunk_size < sector_left)
-            block_read (fs_device, sector_idx, bounce);
-          else
-            memset (bounce, 0, BLOCK_SECTOR_SIZE);
-          memcpy (bounce + sector_ofs, buffer + bytes_written, chunk_size);
-          block_write (fs_device, sector_idx, bounce);
+          cache_write_new (sector_idx, buffer + bytes_written, sector_ofs,
+                           chunk_size, inode_is_meta (inode));
+          inode->data.init_cnt = idx + 1;
         }
+      else
+        cache_write_at (sector_idx, buffer + bytes_written, sector_ofs,
+                        chunk_size, inode_is_meta (inode));
 
       /* Advance. */
       size -= chunk_size;
@@ -553,12 +1254,37 @@ off_t inode_write_at (struct inode *inode, const void *buffer_, off_t size,
     {
       inode->data.length = offset;
     }
-  if (acquired_lock)
-    lock_release (&inode->extend_write_lock);
-  free (bounce);
+  if (exclusive)
+    rwlock_release_write (&inode->rw_lock);
+  else
+    rwlock_release_read (&inode->rw_lock);
   return bytes_written;
 }
 
+/* Queues the sectors of INODE that hold bytes OFFSET through
+   OFFSET + LENGTH - 1 to be loaded into the buffer cache in the
+   background.  Parts of the range that lie past end of file, that
+   have no sector allocated or that were never written are
+   skipped, which includes all of an inline inode's data. */
+void inode_readahead (struct inode *inode, off_t offset, off_t length)
+{
+  off_t end = offset + length;
+
+  rwlock_acquire_read (&inode->rw_lock);
+  if (end > inode_length (inode))
+    end = inode_length (inode);
+  if (end > (off_t) inode->data.init_cnt * BLOCK_SECTOR_SIZE)
+    end = (off_t) inode->data.init_cnt * BLOCK_SECTOR_SIZE;
+  for (offset = ROUND_DOWN (offset, BLOCK_SECTOR_SIZE); offset < end;
+       offset += BLOCK_SECTOR_SIZE)
+    {
+      block_sector_t sector = byte_to_sector (inode, offset, false);
+      if (sector != UNALLOCATED_SECTOR)
+        cache_readahead (sector);
+    }
+  rwlock_release_read (&inode->rw_lock);
+}
+
 /* Disables writes to INODE.
    May be called at most once per inode opener. */
 void inode_deny_write (struct inode *inode)
@@ -4,6 +4,7 @@
 #include <stdbool.h>
 #include "filesys/off_t.h"
 #include "devices/block.h"
+#include <hash.h>
 #include <list.h>
 #include "threads/synch.h"
 
@@ -11,19 +12,47 @@
 #define UNALLOCATED_SECTOR (block_sector_t) - 1
 
 #define NUM_DIRECT_INDICES                                                     \
-  ((BLOCK_SECTOR_SIZE - sizeof (bool) - sizeof (off_t) - sizeof (unsigned) -   \
+  ((BLOCK_SECTOR_SIZE - 2 * sizeof (bool) - sizeof (off_t) -                   \
+    sizeof (unsigned) -                                                        \
+    sizeof (block_sector_t) - sizeof (block_sector_t) -                        \
     sizeof (block_sector_t) - sizeof (block_sector_t)) /                       \
    sizeof (block_sector_t))
 
 #define INDICES_PER_BLOCK (BLOCK_SECTOR_SIZE / sizeof (block_sector_t))
 
+/* Largest file, in bytes: the direct sectors plus those reached
+   through the single, double and triple indirect blocks.  This is
+   just over 1 GB, which still fits in an off_t. */
 #define MX_FILE_LEN                                                            \
-  (NUM_DIRECT_INDICES + (INDICES_PER_BLOCK + 1) * INDICES_PER_BLOCK) *         \
-      BLOCK_SECTOR_SIZE
+  ((off_t) ((NUM_DIRECT_INDICES + INDICES_PER_BLOCK +                          \
+             INDICES_PER_BLOCK * INDICES_PER_BLOCK +                           \
+             INDICES_PER_BLOCK * INDICES_PER_BLOCK * INDICES_PER_BLOCK) *      \
+            BLOCK_SECTOR_SIZE))
+
+/* A run of consecutive sectors in an extent-based inode. */
+struct extent
+{
+  block_sector_t start;  /* First sector of the run. */
+  block_sector_t length; /* Number of sectors in the run. */
+};
+
+/* Number of extents stored in an extent-based inode itself.
+   Extents past these live in a chain of overflow blocks. */
+#define NUM_INODE_EXTENTS                                                      \
+  (((NUM_DIRECT_INDICES + 3) * sizeof (block_sector_t) -                       \
+    3 * sizeof (block_sector_t)) /                                             \
+   sizeof (struct extent))
+
+/* Number of data bytes an inode can hold in place of its block
+   map.  Files no longer than this need no data sectors. */
+#define INODE_INLINE_BYTES ((NUM_DIRECT_INDICES + 3) * sizeof (block_sector_t))
 
 struct bitmap;
 
 void inode_init (void);
+void inode_done (void);
+bool inode_reclaim_prealloc (void);
+void inode_set_extents (bool);
 bool inode_create (block_sector_t, off_t);
 struct inode *inode_open (block_sector_t);
 struct inode *inode_reopen (struct inode *);
@@ -32,28 +61,92 @@ void inode_close (struct inode *);
 void inode_remove (struct inode *);
 off_t inode_read_at (struct inode *, void *, off_t size, off_t offset);
 off_t inode_write_at (struct inode *, const void *, off_t size, off_t offset);
+void inode_readahead (struct inode *, off_t offset, off_t length);
 void inode_deny_write (struct inode *);
 void inode_allow_write (struct inode *);
 off_t inode_length (const struct inode *);
+bool inode_has_extents (const struct inode *);
+bool inode_is_inline (const struct inode *);
 
 /* On-disk inode.
    Must be exactly BLOCK_SECTOR_SIZE bytes long. */
 struct inode_disk
 {
   bool is_directory; /* True if this inode is a directory*/
+  bool is_inline;    /* True if the data is stored in INLINE_DATA. */
   off_t length;      /* File size in bytes. */
-  block_sector_t direct_pointers[NUM_DIRECT_INDICES];
-  block_sector_t levelone_pointer;
-  block_sector_t leveltwo_pointer;
+  block_sector_t init_cnt; /* Data sectors written so far.  Later
+                              sectors, even if allocated, have never
+                              been written and read as zeros. */
+  union
+  {
+    /* Indexed layout, used if MAGIC is INODE_MAGIC. */
+    struct
+    {
+      block_sector_t direct_pointers[NUM_DIRECT_INDICES];
+      block_sector_t levelone_pointer;
+      block_sector_t leveltwo_pointer;
+      block_sector_t levelthree_pointer;
+    };
+
+    /* Extent layout, used if MAGIC is INODE_EXTENT_MAGIC. */
+    struct
+    {
+      block_sector_t sector_cnt;   /* Sectors mapped by all extents. */
+      uint32_t extent_cnt;         /* Number of extents. */
+      block_sector_t extent_block; /* First overflow block, if any. */
+      struct extent extents[NUM_INODE_EXTENTS];
+    };
+
+    /* Contents of a file stored in the inode itself, used if
+       IS_INLINE is true.  MAGIC still names the layout the file
+       moves to once it outgrows this. */
+    uint8_t inline_data[INODE_INLINE_BYTES];
+  };
   unsigned magic; /* Magic number. */
 };
 
+/* Sectors reserved for a file's future growth, so that its
+   blocks are laid out contiguously. */
+struct prealloc
+{
+  block_sector_t start; /* First reserved sector. */
+  size_t cnt;           /* Number of reserved sectors. */
+  size_t fill;          /* Sectors to reserve when CNT reaches 0. */
+};
+
+/* Number of indirect index blocks that an open inode keeps
+   decoded in memory. */
+#define INDEX_CACHE_SLOTS 4
+
+/* Decoded copy of one of an open inode's indirect index blocks. */
+struct index_slot
+{
+  block_sector_t sector; /* Index block's sector, or UNALLOCATED_SECTOR. */
+  unsigned last_use;     /* Owner's index_clock at last lookup. */
+  block_sector_t *map;   /* INDICES_PER_BLOCK entries, or null. */
+};
+
+/* Where an extent-based inode's last lookup found its sector, so
+   that the next lookup at or past it need not walk the extents
+   from the start.  Extents are only ever appended, so a hint stays
+   valid until the inode is closed. */
+struct extent_hint
+{
+  uint32_t idx;         /* Index of the extent. */
+  block_sector_t first; /* File sector that the extent starts at. */
+  block_sector_t block; /* Overflow block holding the extent, or
+                           UNALLOCATED_SECTOR if in the inode. */
+};
+
 /* In-memory inode. */
 struct inode
 {
-  struct list_elem elem;         /* Element in inode list. */
-  struct lock extend_write_lock; /* Lock for writes that extend inode length */
-  struct lock dir_lock;          /* Lock for directory operations if needed */
+  struct hash_elem elem;         /* Element in open inode table. */
+  struct rwlock rw_lock;  /* Read for reads and writes within the
+                             inode, write for writes that extend it */
+  struct rwlock dir_lock; /* Read for directory lookups, write for
+                             directory changes */
   struct lock block_op_wait; /* Allows for waiting for inode's data to be read
                                 in from block */
   struct lock op_lock;    /* Ensures modifications to variables is atomic */
@@ -61,6 +154,11 @@ struct inode
   int open_cnt;           /* Number of openers. */
   bool removed;           /* True if deleted, false otherwise. */
   int deny_write_cnt;     /* 0: writes ok, >0: deny writes. */
+  struct lock index_lock; /* Protects block map lookups and index_cache. */
+  struct index_slot index_cache[INDEX_CACHE_SLOTS]; /* Index blocks. */
+  unsigned index_clock;   /* Counts index_cache lookups, for LRU. */
+  struct prealloc prealloc; /* Reserved sectors, under index_lock. */
+  struct extent_hint extent_hint; /* Last extent found, under index_lock. */
   struct inode_disk data; /* Inode content. */
 };
 
@@ -0,0 +1,370 @@
+#include "filesys/journal.h"
+#include <bitmap.h>
+#include <debug.h>
+#include <hash.h>
+#include <round.h>
+#include <stdint.h>
+#include <string.h>
+#include "filesys/cache.h"
+#include "filesys/filesys.h"
+#include "filesys/free-map.h"
+#include "threads/synch.h"
+
+/* Metadata journal.
+
+   Changes to metadata sectors (inodes, index and extent blocks,
+   directory contents and the free map) are not written in place
+   right away.  They stay in the buffer cache until a group commit
+   appends every changed sector to the journal, a region of
+   JOURNAL_SECTORS sectors starting at JOURNAL_SECTOR, followed by
+   a commit block.  Only then may the buffer cache write them in
+   place.  Commits happen periodically from the flusher thread,
+   whenever too much of the cache holds uncommitted metadata, and
+   at shutdown.
+
+   The journal's first sector is a header.  Transactions follow it
+   back to back, each made of one or more descriptor blocks, each
+   followed by the sectors it lists, and then a commit block.  When
+   the next transaction does not fit, every committed sector is
+   written in place and the journal starts over, which is called a
+   checkpoint.  Mounting replays the complete transactions in order
+   and then checkpoints.
+
+   A sector logged since the last checkpoint is logged again
+   whenever it changes, even if it has since been freed and now
+   holds file data, so that replay never overwrites newer data with
+   an older copy. */
+
+/* Magic numbers. */
+#define JOURNAL_MAGIC 0x4c4e524a /* "JRNL": header. */
+#define DESC_MAGIC 0x4353444a    /* "JDSC": descriptor block. */
+#define COMMIT_MAGIC 0x544d434a  /* "JCMT": commit block. */
+
+/* Number of sectors listed by one descriptor block. */
+#define DESC_SECTORS                                                           \
+  ((BLOCK_SECTOR_SIZE - 3 * sizeof (uint32_t)) / sizeof (block_sector_t))
+
+/* A journal sector other than a logged copy of a sector. */
+union journal_block
+{
+  /* Header, in the journal's first sector. */
+  struct
+  {
+    uint32_t magic; /* JOURNAL_MAGIC. */
+    uint32_t seq;   /* Sequence number of the first transaction. */
+  } header;
+
+  /* Descriptor block. */
+  struct
+  {
+    uint32_t magic;                       /* DESC_MAGIC. */
+    uint32_t seq;                         /* Transaction's number. */
+    uint32_t cnt;                         /* Number of SECTORS used. */
+    block_sector_t sectors[DESC_SECTORS]; /* Where each following
+                                             block belongs. */
+  } desc;
+
+  /* Commit block, which ends a transaction. */
+  struct
+  {
+    uint32_t magic;    /* COMMIT_MAGIC. */
+    uint32_t seq;      /* Transaction's number. */
+    uint32_t cnt;      /* Number of sectors logged. */
+    uint32_t checksum; /* Checksum of the sectors logged. */
+  } commit;
+
+  uint8_t data[BLOCK_SECTOR_SIZE];
+};
+
+static bool active;            /* Does the file system have a journal? */
+static uint32_t next_seq;      /* Number of the next transaction. */
+static block_sector_t head;    /* Journal offset for the next transaction. */
+static struct bitmap *logged;  /* Sectors logged since the last checkpoint. */
+static union journal_block jb; /* Descriptor or commit being built. */
+
+/* Held for reading while a cached sector is changed, and for
+   writing by a commit, so that a transaction never holds half of a
+   change. */
+static struct rwlock journal_rw;
+
+/* Adds logged SECTOR, whose contents are DATA, to CHECKSUM. */
+static uint32_t checksum_add (uint32_t checksum, block_sector_t sector,
+                              const void *data)
+{
+  return (checksum * 31 + sector) ^ hash_bytes (data, BLOCK_SECTOR_SIZE);
+}
+
+/* Writes the journal header, making the journal empty with NEXT_SEQ
+   as the number of its first transaction. */
+static void write_header (void)
+{
+  memset (&jb, 0, sizeof jb);
+  jb.header.magic = JOURNAL_MAGIC;
+  jb.header.seq = next_seq;
+  block_write (fs_device, JOURNAL_SECTOR, &jb);
+}
+
+/* Starts an empty journal whose first transaction is number SEQ. */
+static void start (uint32_t seq)
+{
+  ASSERT (sizeof jb == BLOCK_SECTOR_SIZE);
+
+  rwlock_init (&journal_rw);
+  logged = bitmap_create (block_size (fs_device));
+  if (logged == NULL)
+    PANIC ("couldn't allocate journal");
+  next_seq = seq;
+  head = 1;
+  write_header ();
+  active = true;
+}
+
+/* Creates an empty journal while formatting.  Metadata written
+   before this is simply written in place. */
+void journal_create (void) { start (1); }
+
+/* If transaction number SEQ starts at journal offset POS and is
+   complete, returns the offset just past its commit block.
+   Otherwise returns 0. */
+static block_sector_t scan_transaction (block_sector_t pos, uint32_t seq)
+{
+  static uint8_t data[BLOCK_SECTOR_SIZE];
+  uint32_t checksum = 0;
+  uint32_t cnt = 0;
+
+  for (;;)
+    {
+      size_t i;
+
+      if (pos >= JOURNAL_SECTORS)
+        return 0;
+      block_read (fs_device, JOURNAL_SECTOR + pos, &jb);
+      if (jb.desc.seq != seq)
+        return 0;
+      if (jb.commit.magic == COMMIT_MAGIC)
+        return jb.commit.cnt == cnt && jb.commit.checksum == checksum ? pos + 1
+                                                                       : 0;
+      if (jb.desc.magic != DESC_MAGIC || jb.desc.cnt == 0 ||
+          jb.desc.cnt > DESC_SECTORS ||
+          pos + 1 + jb.desc.cnt >= JOURNAL_SECTORS)
+        return 0;
+
+      for (i = 0; i < jb.desc.cnt; i++)
+        {
+          block_read (fs_device, JOURNAL_SECTOR + pos + 1 + i, data);
+          checksum = checksum_add (checksum, jb.desc.sectors[i], data);
+        }
+      cnt += jb.desc.cnt;
+      pos += 1 + jb.desc.cnt;
+    }
+}
+
+/* Copies the sectors logged by the complete transaction at
+   journal offset POS to their places: all of them, or if PENDING
+   is true, only those whose cached copies hold uncommitted
+   changes.  Returns the offset just past its commit block. */
+static block_sector_t replay_transaction (block_sector_t pos, bool pending)
+{
+  static uint8_t data[BLOCK_SECTOR_SIZE];
+
+  for (;;)
+    {
+      size_t i;
+
+      block_read (fs_device, JOURNAL_SECTOR + pos, &jb);
+      if (jb.desc.magic != DESC_MAGIC)
+        return pos + 1;
+      for (i = 0; i < jb.desc.cnt; i++)
+        if (!pending || cache_uncommitted (jb.desc.sectors[i]))
+          {
+            block_read (fs_device, JOURNAL_SECTOR + pos + 1 + i, data);
+            block_write (fs_device, jb.desc.sectors[i], data);
+          }
+      pos += 1 + jb.desc.cnt;
+    }
+}
+
+/* Replays the transactions committed to the journal and starts an
+   empty one.  Must be called before any metadata is read.  File
+   systems formatted without a journal are left alone. */
+void journal_open (void)
+{
+  block_sector_t pos, end;
+  uint32_t seq;
+
+  active = false;
+  block_read (fs_device, JOURNAL_SECTOR, &jb);
+  if (jb.header.magic != JOURNAL_MAGIC)
+    return;
+
+  seq = jb.header.seq;
+  for (pos = 1; (end = scan_transaction (pos, seq)) != 0; pos = end)
+    {
+      replay_transaction (pos, false);
+      seq++;
+    }
+  start (seq);
+}
+
+/* Returns true if metadata changes go through the journal. */
+bool journal_active (void) { return active; }
+
+/* Writes every committed sector in place and empties the journal.
+   The journal lock must be held for writing, and no commit may be
+   in progress, because cache_flush() skips the sectors being
+   committed and the journal may hold the only committed copy of
+   them. */
+static void checkpoint (void)
+{
+  block_sector_t pos;
+
+  cache_flush ();
+
+  /* cache_flush() skips sectors changed again since they were
+     committed, so their committed copies are still only in the
+     journal.  Copy those in place before the journal goes. */
+  for (pos = 1; pos < head;)
+    pos = replay_transaction (pos, true);
+
+  bitmap_set_all (logged, false);
+  head = 1;
+  write_header ();
+}
+
+/* A descriptor block followed by the sectors it lists, as written
+   by write_transaction(). */
+static const void *desc_run[DESC_SECTORS + 1];
+
+/* Appends the CNT sectors gathered by cache_begin_commit() to the
+   journal as the next transaction, which must fit.  Each
+   descriptor block goes to disk in one request along with the
+   sectors it lists. */
+static void write_transaction (size_t cnt)
+{
+  block_sector_t pos = head;
+  uint32_t checksum = 0;
+  size_t i, j, n;
+
+  for (i = 0; i < cnt; i += n)
+    {
+      n = cnt - i < DESC_SECTORS ? cnt - i : DESC_SECTORS;
+      memset (&jb, 0, sizeof jb);
+      jb.desc.magic = DESC_MAGIC;
+      jb.desc.seq = next_seq;
+      jb.desc.cnt = n;
+      desc_run[0] = &jb;
+      for (j = 0; j < n; j++)
+        {
+          block_sector_t sector;
+          const void *data = cache_commit_entry (i + j, &sector);
+          jb.desc.sectors[j] = sector;
+          desc_run[j + 1] = data;
+          checksum = checksum_add (checksum, sector, data);
+          bitmap_mark (logged, sector);
+        }
+      block_writev (fs_device, JOURNAL_SECTOR + pos, n + 1, desc_run);
+      pos += n + 1;
+    }
+
+  memset (&jb, 0, sizeof jb);
+  jb.commit.magic = COMMIT_MAGIC;
+  jb.commit.seq = next_seq;
+  jb.commit.cnt = cnt;
+  jb.commit.checksum = checksum;
+  block_write (fs_device, JOURNAL_SECTOR + pos++, &jb);
+
+  head = pos;
+  next_seq++;
+}
+
+/* Commits every metadata change made since the last commit, along
+   with the free map, as one transaction.  Afterward the buffer
+   cache may write the changed sectors in place. */
+void journal_commit (void)
+{
+  size_t cnt, len;
+
+  if (!active)
+    return;
+
+  rwlock_acquire_write (&journal_rw);
+  free_map_flush ();
+
+  /* Nothing can change the cache while we hold the journal lock,
+     so the transaction will be exactly CNT sectors long.  Make room
+     for it before the commit starts. */
+  cnt = cache_meta_count ();
+  len = cnt + DIV_ROUND_UP (cnt, DESC_SECTORS) + 1;
+  if (cnt > 0 && head + len > JOURNAL_SECTORS)
+    checkpoint ();
+
+  cnt = cache_begin_commit ();
+  if (cnt > 0)
+    {
+      ASSERT (len == cnt + DIV_ROUND_UP (cnt, DESC_SECTORS) + 1);
+      if (head + len <= JOURNAL_SECTORS)
+        write_transaction (cnt);
+      else
+        {
+          /* Larger than the whole journal.  Write it in place
+             instead, which is safe after the checkpoint but not
+             atomic. */
+          cache_end_commit ();
+          cache_flush ();
+          rwlock_release_write (&journal_rw);
+          return;
+        }
+    }
+  cache_end_commit ();
+  rwlock_release_write (&journal_rw);
+}
+
+/* Commits outstanding changes and checkpoints the journal, so that
+   the next mount has nothing to replay. */
+void journal_done (void)
+{
+  if (!active)
+    return;
+  journal_commit ();
+  rwlock_acquire_write (&journal_rw);
+  checkpoint ();
+  rwlock_release_write (&journal_rw);
+}
+
+/* Must be called before changing cached SECTOR, which holds
+   metadata if META is true, and followed by journal_end() once the
+   change is made.  Returns true if the change must be committed
+   through the journal before SECTOR is written in place.  Commits
+   first if too much metadata is already waiting.
+
+   Only changes that go through the journal wait for a commit in
+   progress.  Plain file data in a sector the journal has never
+   seen is written without the journal lock, so that writers do not
+   stall behind the commit's disk I/O.  Such a sector cannot join
+   the journal meanwhile, since only changes made under the lock
+   are logged. */
+bool journal_begin (block_sector_t sector, bool meta)
+{
+  if (!active)
+    return false;
+
+  /* The committing thread writes the free map into the
+     transaction it is building. */
+  if (rwlock_held_for_write (&journal_rw))
+    return true;
+
+  if (!meta && !bitmap_test (logged, sector) && !cache_uncommitted (sector))
+    return false;
+  if (meta && cache_meta_full ())
+    journal_commit ();
+  rwlock_acquire_read (&journal_rw);
+  return true;
+}
+
+/* Ends a change started with journal_begin(), which returned
+   LOGGED. */
+void journal_end (bool logged)
+{
+  if (logged && active && !rwlock_held_for_write (&journal_rw))
+    rwlock_release_read (&journal_rw);
+}
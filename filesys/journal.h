@@ -0,0 +1,19 @@
+#ifndef FILESYS_JOURNAL_H
+#define FILESYS_JOURNAL_H
+
+#include <stdbool.h>
+#include "devices/block.h"
+
+/* Number of sectors in the journal, starting at JOURNAL_SECTOR. */
+#define JOURNAL_SECTORS 128
+
+void journal_create (void);
+void journal_open (void);
+void journal_done (void);
+bool journal_active (void);
+void journal_commit (void);
+
+bool journal_begin (block_sector_t, bool meta);
+void journal_end (bool logged);
+
+#endif /* filesys/journal.h */
@@ -0,0 +1,17 @@
+#ifndef __LIB_IOVEC_H
+#define __LIB_IOVEC_H
+
+#include <stddef.h>
+
+/* One buffer of a scatter/gather I/O vector, as passed to the
+   readv() and writev() system calls. */
+struct iovec
+{
+  void *iov_base; /* Start of the buffer. */
+  size_t iov_len; /* Size of the buffer in bytes. */
+};
+
+/* Maximum number of buffers in one I/O vector. */
+#define IOV_MAX 1024
+
+#endif /* lib/iovec.h */
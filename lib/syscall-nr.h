@@ -28,7 +28,15 @@ enum
   SYS_MKDIR,   /* Create a directory. */
   SYS_READDIR, /* Reads a directory entry. */
   SYS_ISDIR,   /* Tests if a fd represents a directory. */
-  SYS_INUMBER  /* Returns the inode number for a fd. */
+  SYS_INUMBER, /* Returns the inode number for a fd. */
+
+  /* Positional and vectored I/O. */
+  SYS_PREAD,  /* Read from a file at a given position. */
+  SYS_PWRITE, /* Write to a file at a given position. */
+  SYS_READV,  /* Read from a file into several buffers. */
+  SYS_WRITEV, /* Write to a file from several buffers. */
+  SYS_COPY_FILE_RANGE, /* Copy data from one file to another. */
+  SYS_GETDENTS         /* Read several directory entries. */
 };
 
 #endif /* lib/syscall-nr.h */
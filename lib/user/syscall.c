@@ -52,6 +52,20 @@
     retval;                                                                    \
   })
 
+/* Invokes syscall NUMBER, passing arguments ARG0, ARG1, ARG2,
+   and ARG3, and returns the return value as an `int'. */
+#define syscall4(NUMBER, ARG0, ARG1, ARG2, ARG3)                               \
+  ({                                                                           \
+    int retval;                                                                \
+    asm volatile("pushl %[arg3]; pushl %[arg2]; pushl %[arg1]; "               \
+                 "pushl %[arg0]; pushl %[number]; int $0x30; addl $20, %%esp"  \
+                 : "=a"(retval)                                                \
+                 : [number] "i"(NUMBER), [arg0] "r"(ARG0), [arg1] "r"(ARG1),   \
+                   [arg2] "r"(ARG2), [arg3] "r"(ARG3)                          \
+                 : "memory");                                                  \
+    retval;                                                                    \
+  })
+
 void halt (void)
 {
   syscall0 (SYS_HALT);
@@ -107,3 +121,33 @@ bool readdir (int fd, char name[READDIR_MAX_LEN + 1])
 bool isdir (int fd) { return syscall1 (SYS_ISDIR, fd); }
 
 int inumber (int fd) { return syscall1 (SYS_INUMBER, fd); }
+
+int getdents (int fd, struct dirent *entries, unsigned cnt)
+{
+  return syscall3 (SYS_GETDENTS, fd, entries, cnt);
+}
+
+int pread (int fd, void *buffer, unsigned size, unsigned position)
+{
+  return syscall4 (SYS_PREAD, fd, buffer, size, position);
+}
+
+int pwrite (int fd, const void *buffer, unsigned size, unsigned position)
+{
+  return syscall4 (SYS_PWRITE, fd, buffer, size, position);
+}
+
+int readv (int fd, const struct iovec *iov, int iovcnt)
+{
+  return syscall3 (SYS_READV, fd, iov, iovcnt);
+}
+
+int writev (int fd, const struct iovec *iov, int iovcnt)
+{
+  return syscall3 (SYS_WRITEV, fd, iov, iovcnt);
+}
+
+int copy_file_range (int in_fd, int out_fd, unsigned length)
+{
+  return syscall3 (SYS_COPY_FILE_RANGE, in_fd, out_fd, length);
+}
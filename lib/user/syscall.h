@@ -3,6 +3,8 @@
 
 #include <stdbool.h>
 #include <debug.h>
+#include <dirent.h>
+#include <iovec.h>
 
 /* Process identifier. */
 typedef int pid_t;
@@ -40,5 +42,13 @@ bool mkdir (const char *dir);
 bool readdir (int fd, char name[READDIR_MAX_LEN + 1]);
 bool isdir (int fd);
 int inumber (int fd);
+int getdents (int fd, struct dirent *entries, unsigned cnt);
+
+/* Positional and vectored I/O. */
+int pread (int fd, void *buffer, unsigned length, unsigned position);
+int pwrite (int fd, const void *buffer, unsigned length, unsigned position);
+int readv (int fd, const struct iovec *iov, int iovcnt);
+int writev (int fd, const struct iovec *iov, int iovcnt);
+int copy_file_range (int in_fd, int out_fd, unsigned length);
 
 #endif /* lib/user/syscall.h */
@@ -0,0 +1,8 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+my ($data) = join ('', map (chr (ord ('a') + $_ % 26), 0...599));
+check_archive ({"src" => [$data . substr ($data, 0, 100)],
+		"dst" => [$data]});
+pass;
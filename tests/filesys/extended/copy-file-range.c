@@ -0,0 +1,52 @@
+/* Tests copy_file_range(), including a copy that reaches the end
+   of the source file and copies within one file. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+static char buf[700];
+
+void test_main (void)
+{
+  int src, dst, src2;
+  size_t i;
+
+  for (i = 0; i < 600; i++)
+    buf[i] = 'a' + i % 26;
+
+  CHECK (create ("src", 0), "create \"src\"");
+  CHECK (create ("dst", 0), "create \"dst\"");
+  CHECK ((src = open ("src")) > 1, "open \"src\"");
+  CHECK ((dst = open ("dst")) > 1, "open \"dst\"");
+  CHECK (write (src, buf, 600) == 600, "write \"src\"");
+  msg ("seek \"src\" to 0");
+  seek (src, 0);
+
+  CHECK (copy_file_range (src, dst, 1000) == 600,
+         "copy 1000 bytes, short at end of file");
+  CHECK (tell (src) == 600 && tell (dst) == 600, "both positions are 600");
+  CHECK (copy_file_range (src, dst, 1000) == 0, "copy at end of file");
+
+  CHECK ((src2 = open ("src")) > 1, "open \"src\" again");
+  msg ("seek \"src\" to 0 and 100");
+  seek (src, 0);
+  seek (src2, 100);
+  CHECK (copy_file_range (src, src2, 200) == -1,
+         "overlapping copy within \"src\" refused");
+  CHECK (tell (src) == 0 && tell (src2) == 100, "positions unchanged");
+
+  msg ("seek second \"src\" to 600");
+  seek (src2, 600);
+  CHECK (copy_file_range (src, src2, 100) == 100,
+         "copy 100 bytes within \"src\" without overlap");
+  memcpy (buf + 600, buf, 100);
+
+  msg ("close \"src\" and \"dst\"");
+  close (src);
+  close (src2);
+  close (dst);
+  check_file ("src", buf, 700);
+  check_file ("dst", buf, 600);
+}
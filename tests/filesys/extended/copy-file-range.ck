@@ -0,0 +1,31 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(copy-file-range) begin
+(copy-file-range) create "src"
+(copy-file-range) create "dst"
+(copy-file-range) open "src"
+(copy-file-range) open "dst"
+(copy-file-range) write "src"
+(copy-file-range) seek "src" to 0
+(copy-file-range) copy 1000 bytes, short at end of file
+(copy-file-range) both positions are 600
+(copy-file-range) copy at end of file
+(copy-file-range) open "src" again
+(copy-file-range) seek "src" to 0 and 100
+(copy-file-range) overlapping copy within "src" refused
+(copy-file-range) positions unchanged
+(copy-file-range) seek second "src" to 600
+(copy-file-range) copy 100 bytes within "src" without overlap
+(copy-file-range) close "src" and "dst"
+(copy-file-range) open "src" for verification
+(copy-file-range) verified contents of "src"
+(copy-file-range) close "src"
+(copy-file-range) open "dst" for verification
+(copy-file-range) verified contents of "dst"
+(copy-file-range) close "dst"
+(copy-file-range) end
+EOF
+pass;
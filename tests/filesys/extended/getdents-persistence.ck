@@ -0,0 +1,9 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+my ($tree);
+$tree->{'dir'}{"f$_"} = [''] foreach 0...19;
+$tree->{'dir'}{'sub'} = {};
+check_archive ($tree);
+pass;
@@ -0,0 +1,73 @@
+/* Tests getdents(), reading a directory a few entries at a time
+   and then all at once with a count larger than a page holds. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define FILE_CNT 20
+
+static struct dirent entries[300];
+
+/* Reads directory FD to its end, CNT entries at a time, and checks
+   that it holds FILE_CNT files and the subdirectory "sub" exactly
+   once each. */
+static void read_all (int fd, unsigned cnt)
+{
+  int seen[FILE_CNT + 1];
+  int n, i;
+
+  memset (seen, 0, sizeof seen);
+  while ((n = getdents (fd, entries, cnt)) != 0)
+    {
+      if (n < 0 || (unsigned) n > cnt)
+        fail ("getdents returned %d for a count of %u", n, cnt);
+      for (i = 0; i < n; i++)
+        {
+          struct dirent *e = &entries[i];
+          int idx = !strcmp (e->name, "sub") ? FILE_CNT : atoi (e->name + 1);
+          if (e->inumber <= 0)
+            fail ("\"%s\" has inode number %d", e->name, e->inumber);
+          if (e->is_dir != (idx == FILE_CNT))
+            fail ("\"%s\" has the wrong type", e->name);
+          if (idx < 0 || idx > FILE_CNT || seen[idx]++)
+            fail ("unexpected entry \"%s\"", e->name);
+        }
+    }
+  for (i = 0; i <= FILE_CNT; i++)
+    if (!seen[i])
+      fail ("entry %d missing", i);
+}
+
+void test_main (void)
+{
+  char name[16];
+  int fd, i;
+
+  CHECK (mkdir ("dir"), "mkdir \"dir\"");
+  CHECK (mkdir ("dir/sub"), "mkdir \"dir/sub\"");
+  msg ("creating %d files in \"dir\"", FILE_CNT);
+  for (i = 0; i < FILE_CNT; i++)
+    {
+      snprintf (name, sizeof name, "dir/f%d", i);
+      if (!create (name, 0))
+        fail ("create \"%s\" failed", name);
+    }
+
+  CHECK ((fd = open ("dir")) > 1, "open \"dir\"");
+  CHECK (getdents (fd, entries, 0) == -1, "getdents with a count of 0");
+  msg ("read \"dir\" 3 entries at a time");
+  read_all (fd, 3);
+  CHECK (getdents (fd, entries, 3) == 0, "getdents at end of directory");
+  msg ("close \"dir\"");
+  close (fd);
+
+  CHECK ((fd = open ("dir")) > 1, "open \"dir\" again");
+  msg ("read \"dir\" with a count larger than a page");
+  read_all (fd, 100000);
+  msg ("close \"dir\"");
+  close (fd);
+}
@@ -0,0 +1,20 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(getdents) begin
+(getdents) mkdir "dir"
+(getdents) mkdir "dir/sub"
+(getdents) creating 20 files in "dir"
+(getdents) open "dir"
+(getdents) getdents with a count of 0
+(getdents) read "dir" 3 entries at a time
+(getdents) getdents at end of directory
+(getdents) close "dir"
+(getdents) open "dir" again
+(getdents) read "dir" with a count larger than a page
+(getdents) close "dir"
+(getdents) end
+EOF
+pass;
@@ -0,0 +1,8 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+my ($data) = join ('', map (chr (ord ('a') + $_ % 26), 0...999));
+substr ($data, 500, 3) = "XYZ";
+check_archive ({"data" => [$data]});
+pass;
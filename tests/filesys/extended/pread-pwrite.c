@@ -0,0 +1,48 @@
+/* Tests pread() and pwrite(), which transfer data at a given
+   offset without moving the file position. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+static char buf[1000];
+static char rbuf[100];
+
+void test_main (void)
+{
+  const char *file_name = "data";
+  size_t i;
+  int fd;
+
+  for (i = 0; i < sizeof buf; i++)
+    buf[i] = 'a' + i % 26;
+
+  CHECK (create (file_name, 0), "create \"%s\"", file_name);
+  CHECK ((fd = open (file_name)) > 1, "open \"%s\"", file_name);
+  CHECK (write (fd, buf, sizeof buf) == sizeof buf, "write \"%s\"",
+         file_name);
+  msg ("seek \"%s\" to 10", file_name);
+  seek (fd, 10);
+
+  CHECK (pread (fd, rbuf, 100, 300) == 100, "pread 100 bytes at 300");
+  compare_bytes (rbuf, buf + 300, 100, 300, file_name);
+  CHECK (tell (fd) == 10, "file position still 10");
+
+  CHECK (pwrite (fd, "XYZ", 3, 500) == 3, "pwrite 3 bytes at 500");
+  CHECK (tell (fd) == 10, "file position still 10");
+  memcpy (buf + 500, "XYZ", 3);
+  CHECK (pread (fd, rbuf, 7, 498) == 7, "pread 7 bytes at 498");
+  compare_bytes (rbuf, buf + 498, 7, 498, file_name);
+
+  CHECK (pread (fd, rbuf, 100, 990) == 10, "pread 100 bytes at 990");
+  compare_bytes (rbuf, buf + 990, 10, 990, file_name);
+  CHECK (pread (fd, rbuf, 100, 1000) == 0, "pread at end of file");
+  CHECK (tell (fd) == 10, "file position still 10");
+
+  CHECK (read (fd, rbuf, 5) == 5, "read 5 bytes at the file position");
+  compare_bytes (rbuf, buf + 10, 5, 10, file_name);
+  msg ("close \"%s\"", file_name);
+  close (fd);
+  check_file (file_name, buf, sizeof buf);
+}
@@ -0,0 +1,26 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(pread-pwrite) begin
+(pread-pwrite) create "data"
+(pread-pwrite) open "data"
+(pread-pwrite) write "data"
+(pread-pwrite) seek "data" to 10
+(pread-pwrite) pread 100 bytes at 300
+(pread-pwrite) file position still 10
+(pread-pwrite) pwrite 3 bytes at 500
+(pread-pwrite) file position still 10
+(pread-pwrite) pread 7 bytes at 498
+(pread-pwrite) pread 100 bytes at 990
+(pread-pwrite) pread at end of file
+(pread-pwrite) file position still 10
+(pread-pwrite) read 5 bytes at the file position
+(pread-pwrite) close "data"
+(pread-pwrite) open "data" for verification
+(pread-pwrite) verified contents of "data"
+(pread-pwrite) close "data"
+(pread-pwrite) end
+EOF
+pass;
@@ -0,0 +1,50 @@
+/* Tests readv() and writev(), which transfer data between a file
+   and several buffers in one call. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+static char text[] = "Hello, vectored world";
+static char first[5], second[10], third[20];
+static struct iovec many[IOV_MAX + 1];
+
+void test_main (void)
+{
+  const char *file_name = "vec";
+  struct iovec out[3], in[3];
+  int fd;
+
+  out[0].iov_base = text;
+  out[0].iov_len = 7;
+  out[1].iov_base = text + 7;
+  out[1].iov_len = 9;
+  out[2].iov_base = text + 16;
+  out[2].iov_len = 5;
+  in[0].iov_base = first;
+  in[0].iov_len = sizeof first;
+  in[1].iov_base = second;
+  in[1].iov_len = sizeof second;
+  in[2].iov_base = third;
+  in[2].iov_len = sizeof third;
+
+  CHECK (create (file_name, 0), "create \"%s\"", file_name);
+  CHECK ((fd = open (file_name)) > 1, "open \"%s\"", file_name);
+  CHECK (writev (fd, out, 3) == 21, "writev 3 buffers");
+  CHECK (tell (fd) == 21, "file position is 21");
+
+  msg ("seek \"%s\" to 0", file_name);
+  seek (fd, 0);
+  CHECK (readv (fd, in, 3) == 21, "readv 35 bytes, short at end of file");
+  compare_bytes (first, text, 5, 0, file_name);
+  compare_bytes (second, text + 5, 10, 5, file_name);
+  compare_bytes (third, text + 15, 6, 15, file_name);
+  CHECK (readv (fd, in, 3) == 0, "readv at end of file");
+
+  CHECK (writev (fd, out, 0) == 0, "writev 0 buffers");
+  CHECK (writev (fd, out, -1) == -1, "writev -1 buffers");
+  CHECK (readv (fd, many, IOV_MAX + 1) == -1, "readv IOV_MAX + 1 buffers");
+  msg ("close \"%s\"", file_name);
+  close (fd);
+  check_file (file_name, text, 21);
+}
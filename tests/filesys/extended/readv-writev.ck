@@ -0,0 +1,23 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(readv-writev) begin
+(readv-writev) create "vec"
+(readv-writev) open "vec"
+(readv-writev) writev 3 buffers
+(readv-writev) file position is 21
+(readv-writev) seek "vec" to 0
+(readv-writev) readv 35 bytes, short at end of file
+(readv-writev) readv at end of file
+(readv-writev) writev 0 buffers
+(readv-writev) writev -1 buffers
+(readv-writev) readv IOV_MAX + 1 buffers
+(readv-writev) close "vec"
+(readv-writev) open "vec" for verification
+(readv-writev) verified contents of "vec"
+(readv-writev) close "vec"
+(readv-writev) end
+EOF
+pass;
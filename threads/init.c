@@ -34,6 +34,7 @@
 #ifdef FILESYS
 #include "devices/block.h"
 #include "devices/ide.h"
+#include "filesys/cache.h"
 #include "filesys/filesys.h"
 #include "filesys/fsutil.h"
 #endif
@@ -240,6 +241,12 @@ static char **parse_options (char **argv)
         filesys_bdev_name = value;
       else if (!strcmp (name, "-scratch"))
         scratch_bdev_name = value;
+      else if (!strcmp (name, "-cache"))
+        cache_configure (atoi (value));
+      else if (!strcmp (name, "-iosched"))
+        block_configure_scheduler (value);
+      else if (!strcmp (name, "-extents"))
+        filesys_extents = true;
 #ifdef VM
       else if (!strcmp (name, "-swap"))
         swap_bdev_name = value;
@@ -361,6 +368,9 @@ static void usage (void)
           "  -f                 Format file system device during startup.\n"
           "  -filesys=BDEV      Use BDEV for file system instead of default.\n"
           "  -scratch=BDEV      Use BDEV for scratch instead of default.\n"
+          "  -cache=SECTORS     Cache SECTORS file system sectors in memory.\n"
+          "  -iosched=NAME      Order disk requests by clook (default) or fifo.\n"
+          "  -extents           Format with extent-based inodes (with -f).\n"
 #ifdef VM
           "  -swap=BDEV         Use BDEV for swap instead of default.\n"
 #endif
@@ -322,3 +322,94 @@ void cond_broadcast (struct condition *cond, struct lock *lock)
   while (!list_empty (&cond->waiters))
     cond_signal (cond, lock);
 }
+
+/* Initializes RW, which is initially held by nobody. */
+void rwlock_init (struct rwlock *rw)
+{
+  ASSERT (rw != NULL);
+
+  lock_init (&rw->lock);
+  cond_init (&rw->can_read);
+  cond_init (&rw->can_write);
+  rw->reader_cnt = 0;
+  rw->waiting_writer_cnt = 0;
+  rw->writer = NULL;
+}
+
+/* Acquires RW for reading, sleeping until no writer holds it or
+   is waiting for it.  Readers do not exclude one another.  RW
+   must not already be held by the current thread.
+
+   This function may sleep, so it must not be called within an
+   interrupt handler. */
+void rwlock_acquire_read (struct rwlock *rw)
+{
+  ASSERT (rw != NULL);
+  ASSERT (!intr_context ());
+  ASSERT (rw->writer != thread_current ());
+
+  lock_acquire (&rw->lock);
+  while (rw->writer != NULL || rw->waiting_writer_cnt > 0)
+    cond_wait (&rw->can_read, &rw->lock);
+  rw->reader_cnt++;
+  lock_release (&rw->lock);
+}
+
+/* Releases RW, which the current thread must hold for reading. */
+void rwlock_release_read (struct rwlock *rw)
+{
+  ASSERT (rw != NULL);
+
+  lock_acquire (&rw->lock);
+  ASSERT (rw->reader_cnt > 0);
+  if (--rw->reader_cnt == 0)
+    cond_signal (&rw->can_write, &rw->lock);
+  lock_release (&rw->lock);
+}
+
+/* Acquires RW for writing, sleeping until no other thread holds
+   it.  RW must not already be held by the current thread.
+
+   This function may sleep, so it must not be called within an
+   interrupt handler. */
+void rwlock_acquire_write (struct rwlock *rw)
+{
+  ASSERT (rw != NULL);
+  ASSERT (!intr_context ());
+  ASSERT (rw->writer != thread_current ());
+
+  lock_acquire (&rw->lock);
+  rw->waiting_writer_cnt++;
+  while (rw->writer != NULL || rw->reader_cnt > 0)
+    cond_wait (&rw->can_write, &rw->lock);
+  rw->waiting_writer_cnt--;
+  rw->writer = thread_current ();
+  lock_release (&rw->lock);
+}
+
+/* Releases RW, which the current thread must hold for writing.
+   Hands it to the next waiting writer if there is one, otherwise
+   to every waiting reader. */
+void rwlock_release_write (struct rwlock *rw)
+{
+  ASSERT (rw != NULL);
+  ASSERT (rwlock_held_for_write (rw));
+
+  lock_acquire (&rw->lock);
+  rw->writer = NULL;
+  if (rw->waiting_writer_cnt > 0)
+    cond_signal (&rw->can_write, &rw->lock);
+  else
+    cond_broadcast (&rw->can_read, &rw->lock);
+  lock_release (&rw->lock);
+}
+
+/* Returns true if the current thread holds RW for writing, false
+   otherwise.  (Note that testing whether some other thread holds
+   a lock would be racy.) */
+bool rwlock_held_for_write (const struct rwlock *rw)
+{
+  ASSERT (rw != NULL);
+
+  return rw->writer == thread_current ();
+}
@@ -41,6 +41,26 @@ void cond_wait (struct condition *, struct lock *);
 void cond_signal (struct condition *, struct lock *);
 void cond_broadcast (struct condition *, struct lock *);
 
+/* Readers-writer lock.  Any number of readers may hold it at
+   once, or a single writer.  Waiting writers keep new readers
+   out, so a steady stream of readers cannot starve a writer. */
+struct rwlock
+{
+  struct lock lock;            /* Protects the members below. */
+  struct condition can_read;   /* Signaled when readers may enter. */
+  struct condition can_write;  /* Signaled when a writer may enter. */
+  unsigned reader_cnt;         /* Number of readers holding the lock. */
+  unsigned waiting_writer_cnt; /* Number of writers waiting. */
+  struct thread *writer;       /* Writer holding the lock, if any. */
+};
+
+void rwlock_init (struct rwlock *);
+void rwlock_acquire_read (struct rwlock *);
+void rwlock_release_read (struct rwlock *);
+void rwlock_acquire_write (struct rwlock *);
+void rwlock_release_write (struct rwlock *);
+bool rwlock_held_for_write (const struct rwlock *);
+
 /* Optimization barrier.
 
    The compiler will not reorder operations across an
@@ -1,6 +1,9 @@
 #include "userprog/syscall.h"
 #include "userprog/pagedir.h"
 #include <stdio.h>
+#include <dirent.h>
+#include <iovec.h>
+#include <string.h>
 #include <syscall-nr.h>
 #include "threads/interrupt.h"
 #include "threads/thread.h"
@@ -8,6 +11,7 @@
 #include "filesys/filesys.h"
 #include "filesys/file.h"
 #include "filesys/free-map.h"
+#include "threads/palloc.h"
 static void syscall_handler (struct intr_frame*);
 
 /* Exits current process with status exit_status. Does not return to caller. */
@@ -100,6 +104,147 @@ struct file* get_file (int fd)
   return thread_current ()->open_files[fd - FD_START_VAL];
 }
 
+/* Reads SIZE bytes from FD, which may be the keyboard, into
+   BUFFER, advancing FD's position.  Returns the number of bytes
+   read, or -1 if FD is not open. */
+static int read_fd (int fd, char* buffer, unsigned size)
+{
+  if (fd == 0)
+    {
+      // read from keyboard
+      for (int i = 0; i < size; i++)
+        {
+          *buffer = input_getc ();
+          buffer++;
+        }
+      return size;
+    }
+
+  struct file* file_ptr = get_file (fd);
+  if (file_ptr)
+    {
+      return file_read (file_ptr, buffer, size);
+    }
+  return -1;
+}
+
+/* Writes SIZE bytes from BUFFER to FD, which may be the console,
+   advancing FD's position.  Returns the number of bytes written,
+   0 if FD is not open, or -1 if FD is a directory. */
+static int write_fd (int fd, const void* buffer, unsigned size)
+{
+  if (fd == 1)
+    {
+      // output to system console
+      putbuf (buffer, size);
+      return size;
+    }
+
+  struct file* file_ptr = get_file (fd);
+  if (file_ptr)
+    {
+      // Matthew driving
+      if (file_ptr->inode->data.is_directory)
+        {
+          return -1;
+        }
+      return file_write (file_ptr, buffer, size);
+    }
+  return 0;
+}
+
+/* Checks the IOVCNT-entry I/O vector IOV given by a user program,
+   exiting with code -1 if it or any of its buffers is invalid.
+   Returns false if IOVCNT is out of range or the buffers add up to
+   more bytes than a file can hold. */
+static bool validate_iovec (const struct iovec* iov, int iovcnt)
+{
+  size_t total = 0;
+
+  if (iovcnt < 0 || iovcnt > IOV_MAX)
+    {
+      return false;
+    }
+  if (iovcnt == 0)
+    {
+      return true;
+    }
+  validate_buffer ((char*) iov, iovcnt * sizeof *iov);
+  for (int i = 0; i < iovcnt; i++)
+    {
+      if (iov[i].iov_len > OFF_T_MAX - total)
+        {
+          return false;
+        }
+      total += iov[i].iov_len;
+      if (iov[i].iov_len > 0)
+        {
+          validate_buffer (iov[i].iov_base, iov[i].iov_len);
+        }
+    }
+  return true;
+}
+
+/* Transfers data between FD and the IOVCNT buffers of IOV in order,
+   reading if WRITE is false and writing otherwise, and stops early
+   at the first short transfer.  Returns the total number of bytes
+   transferred, or the error from read_fd() or write_fd() if the
+   first buffer fails. */
+static int transfer_iovec (int fd, const struct iovec* iov, int iovcnt,
+                           bool write)
+{
+  int total = 0;
+
+  for (int i = 0; i < iovcnt; i++)
+    {
+      int cnt = write ? write_fd (fd, iov[i].iov_base, iov[i].iov_len)
+                      : read_fd (fd, iov[i].iov_base, iov[i].iov_len);
+      if (cnt < 0)
+        {
+          return total > 0 ? total : cnt;
+        }
+      total += cnt;
+      if ((size_t) cnt < iov[i].iov_len)
+        {
+          break;
+        }
+    }
+  return total;
+}
+
+/* Clamps POSITION, a file offset given by a user program, to the
+   largest offset.  Past it, reads and writes do nothing, just as
+   anywhere else past the end. */
+static off_t user_offset (unsigned position)
+{
+  return position > OFF_T_MAX ? OFF_T_MAX : (off_t) position;
+}
+
+/* Entries gathered by getdents_entry() for SYS_GETDENTS. */
+struct getdents_batch
+{
+  struct dirent* entries; /* Kernel buffer. */
+  unsigned cnt;           /* Entries stored. */
+  unsigned max_cnt;       /* Room in ENTRIES. */
+};
+
+/* dir_iterate() function for SYS_GETDENTS.  Stores E into the
+   getdents_batch AUX unless it is full. */
+static bool getdents_entry (const struct dir_entry* e, void* aux)
+{
+  struct getdents_batch* batch = aux;
+  struct dirent* d;
+
+  if (batch->cnt == batch->max_cnt)
+    {
+      return false;
+    }
+  d = &batch->entries[batch->cnt++];
+  d->inumber = e->inode_sector;
+  strlcpy (d->name, e->name, sizeof d->name);
+  return true;
+}
+
 void syscall_init (void)
 {
   intr_register_int (0x30, 3, INTR_ON, syscall_handler, "syscall");
@@ -111,7 +256,7 @@ static void syscall_handler (struct intr_frame* f UNUSED)
   struct thread* curr = thread_current ();
   validate_pointer (f->esp, true);
   uint32_t syscall_num = *(uint32_t*) (f->esp);
-  uint32_t *ptr1 = NULL, *ptr2 = NULL, *ptr3 = NULL;
+  uint32_t *ptr1 = NULL, *ptr2 = NULL, *ptr3 = NULL, *ptr4 = NULL;
 
   switch (syscall_num)
     {
@@ -241,25 +386,7 @@ static void syscall_handler (struct intr_frame* f UNUSED)
           unsigned size = *(unsigned*) (ptr3);
           validate_buffer (buffer, size);
 
-          f->eax = -1;
-          if (fd == 0)
-            {
-              // read from keyboard
-              for (int i = 0; i < size; i++)
-                {
-                  *buffer = input_getc ();
-                  buffer++;
-                }
-              f->eax = size;
-            }
-          else
-            {
-              struct file* file_ptr = get_file (fd);
-              if (file_ptr)
-                {
-                  f->eax = file_read (file_ptr, buffer, size);
-                }
-            }
+          f->eax = read_fd (fd, buffer, size);
         }
         break;
         case SYS_WRITE: {
@@ -276,29 +403,7 @@ static void syscall_handler (struct intr_frame* f UNUSED)
           unsigned size = *(unsigned*) ptr3;
           validate_buffer (buffer, size);
 
-          f->eax = 0;
-          if (fd == 1)
-            {
-              // output to system console
-              putbuf (buffer, size);
-              f->eax = size;
-            }
-          else
-            {
-              struct file* file_ptr = get_file (fd);
-              if (file_ptr)
-                {
-                  // Matthew driving
-                  if (file_ptr->inode->data.is_directory)
-                    {
-                      f->eax = -1;
-                    }
-                  else
-                    {
-                      f->eax = file_write (file_ptr, buffer, size);
-                    }
-                }
-            }
+          f->eax = write_fd (fd, buffer, size);
         }
         break;
         case SYS_SEEK: {
@@ -312,7 +417,7 @@ static void syscall_handler (struct intr_frame* f UNUSED)
           struct file* file_ptr = get_file (fd);
           if (file_ptr)
             {
-              file_seek (file_ptr, position);
+              file_seek (file_ptr, user_offset (position));
             }
         }
         break;
@@ -431,5 +536,138 @@ static void syscall_handler (struct intr_frame* f UNUSED)
             }
         }
         break;
+        case SYS_PREAD:
+        case SYS_PWRITE: {
+          ptr1 = get_arg (f->esp, 1);
+          ptr2 = get_arg (f->esp, 2);
+          ptr3 = get_arg (f->esp, 3);
+          ptr4 = get_arg (f->esp, 4);
+          validate_pointer ((char*) ptr1, true);
+          validate_pointer ((char*) ptr2, true);
+          validate_pointer ((char*) ptr3, true);
+          validate_pointer ((char*) ptr4, true);
+
+          int fd = *(int*) (ptr1);
+          void* buffer = *(void**) (ptr2);
+          unsigned size = *(unsigned*) (ptr3);
+          off_t position = user_offset (*(unsigned*) (ptr4));
+          validate_buffer (buffer, size);
+
+          /* Neither call moves the file's position, so they need
+             no seek and may be used by several threads at once. */
+          f->eax = -1;
+          struct file* file_ptr = get_file (fd);
+          if (file_ptr && syscall_num == SYS_PREAD)
+            {
+              f->eax = file_read_at (file_ptr, buffer, size, position);
+            }
+          else if (file_ptr && !file_ptr->inode->data.is_directory)
+            {
+              f->eax = file_write_at (file_ptr, buffer, size, position);
+            }
+        }
+        break;
+        case SYS_READV:
+        case SYS_WRITEV: {
+          ptr1 = get_arg (f->esp, 1);
+          ptr2 = get_arg (f->esp, 2);
+          ptr3 = get_arg (f->esp, 3);
+          validate_pointer ((char*) ptr1, true);
+          validate_pointer ((char*) ptr2, true);
+          validate_pointer ((char*) ptr3, true);
+
+          int fd = *(int*) (ptr1);
+          const struct iovec* iov = *(const struct iovec**) (ptr2);
+          int iovcnt = *(int*) (ptr3);
+
+          f->eax = -1;
+          if (validate_iovec (iov, iovcnt))
+            {
+              f->eax = transfer_iovec (fd, iov, iovcnt,
+                                       syscall_num == SYS_WRITEV);
+            }
+        }
+        break;
+        case SYS_COPY_FILE_RANGE: {
+          ptr1 = get_arg (f->esp, 1);
+          ptr2 = get_arg (f->esp, 2);
+          ptr3 = get_arg (f->esp, 3);
+          validate_pointer ((char*) ptr1, true);
+          validate_pointer ((char*) ptr2, true);
+          validate_pointer ((char*) ptr3, true);
+
+          struct file* in = get_file (*(int*) (ptr1));
+          struct file* out = get_file (*(int*) (ptr2));
+          off_t size = user_offset (*(unsigned*) (ptr3));
+
+          /* Copies within one file must not overlap, or a chunk
+             could be read after an earlier chunk overwrote it. */
+          f->eax = -1;
+          if (in && out && !in->inode->data.is_directory &&
+              !out->inode->data.is_directory &&
+              (in->inode != out->inode || in->pos - out->pos >= size ||
+               out->pos - in->pos >= size))
+            {
+              f->eax = file_copy (out, in, size);
+            }
+        }
+        break;
+        case SYS_GETDENTS: {
+          ptr1 = get_arg (f->esp, 1);
+          ptr2 = get_arg (f->esp, 2);
+          ptr3 = get_arg (f->esp, 3);
+          validate_pointer ((char*) ptr1, true);
+          validate_pointer ((char*) ptr2, true);
+          validate_pointer ((char*) ptr3, true);
+
+          int fd = *(int*) (ptr1);
+          struct dirent* entries = *(struct dirent**) (ptr2);
+          unsigned cnt = *(unsigned*) (ptr3);
+          struct file* file_ptr = get_file (fd);
+
+          /* Gather at most a page of entries in a kernel buffer, and
+             find out which are directories only after the
+             directory's lock is released.  A count of 0 is an error,
+             since returning 0 would mean the end of the directory. */
+          f->eax = -1;
+          if (cnt == 0)
+            {
+              break;
+            }
+          if (cnt > PGSIZE / sizeof *entries)
+            {
+              cnt = PGSIZE / sizeof *entries;
+            }
+          validate_buffer ((char*) entries, cnt * sizeof *entries);
+          if (file_ptr && file_ptr->inode->data.is_directory)
+            {
+              struct getdents_batch batch;
+              struct dir* tempdir = dir_open (inode_reopen (file_ptr->inode));
+              batch.entries = palloc_get_page (0);
+              batch.cnt = 0;
+              batch.max_cnt = cnt;
+              if (tempdir != NULL && batch.entries != NULL)
+                {
+                  // Use struct file's pos as pos to start searching
+                  tempdir->pos = file_ptr->dir_pos;
+                  dir_iterate (tempdir, getdents_entry, &batch);
+                  file_ptr->dir_pos = tempdir->pos;
+                  for (unsigned i = 0; i < batch.cnt; i++)
+                    {
+                      struct inode* inode =
+                          inode_open (batch.entries[i].inumber);
+                      batch.entries[i].is_dir =
+                          inode != NULL && inode->data.is_directory;
+                      inode_close (inode);
+                    }
+                  memcpy (entries, batch.entries,
+                          batch.cnt * sizeof *entries);
+                  f->eax = batch.cnt;
+                }
+              palloc_free_page (batch.entries);
+              dir_close (tempdir);
+            }
+        }
+        break;
     }
 }
\ No newline at end of file
@@ -197,11 +197,8 @@ TRY_ACQUIRE_FRAME:
               list_pop_front (&free_sectors), struct block_sector, elem);
           lock_release (&free_sector_access);
           // Write victim to swap
-          for (int i = 0; i < PGSIZE / BLOCK_SECTOR_SIZE; i++)
-            {
-              block_write (swap_block, free_sector->sector + i,
-                           (char*) evict_tgt->frame + BLOCK_SECTOR_SIZE * i);
-            }
+          block_write_multiple (swap_block, free_sector->sector,
+                                PGSIZE / BLOCK_SECTOR_SIZE, evict_tgt->frame);
           // Update supp_entry of victim
           evict_tgt->frame_supp->swap_sector = free_sector;
           evict_tgt->frame_supp->in_swap = true;
@@ -222,11 +219,8 @@ TRY_ACQUIRE_FRAME:
     {
       ASSERT (!insert_page->in_filesys);
       // Write to frame from swap sector
-      for (int i = 0; i < PGSIZE / BLOCK_SECTOR_SIZE; i++)
-        {
-          block_read (swap_block, insert_page->swap_sector->sector + i,
-                      (char*) frame_data->frame + BLOCK_SECTOR_SIZE * i);
-        }
+      block_read_multiple (swap_block, insert_page->swap_sector->sector,
+                           PGSIZE / BLOCK_SECTOR_SIZE, frame_data->frame);
 
       // Free up swap sector
       insert_page->in_swap = false;